@@ -7,8 +7,15 @@
 #include <cerrno>
 #include <string>
 #include <sstream>
+#include <deque>
+#include <map>
+#include <vector>
+#include <algorithm>
 #include <wchar.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
 
 #ifndef TARGET_WIN32
 
@@ -25,6 +32,15 @@
 	#include <sys/socket.h>
 	#include <sys/time.h>
 	#include <sys/ioctl.h>
+	#include <sys/uio.h>
+	#include <sys/mman.h>
+
+	#ifdef __linux__
+		#include <sched.h>				/* for CPU affinity */
+		#include <dirent.h>
+		#include <linux/net_tstamp.h>	/* for struct sock_txtime */
+		#include <linux/errqueue.h>		/* for MSG_ZEROCOPY completions */
+	#endif
 
     //#ifdef TARGET_LINUX
         // linux needs this:
@@ -32,7 +48,6 @@
     //#endif
 
 
-	#define SO_MAX_MSG_SIZE TCP_MAXSEG
 	#define INVALID_SOCKET -1
 	#define SOCKET_ERROR -1
 	#define FAR
@@ -51,9 +66,78 @@
 
 /// Socket constants.
 #define SOCKET_TIMEOUT			SOCKET_ERROR - 1
+#define ZEROCOPY_COPIED			SOCKET_ERROR - 2
 #define NO_TIMEOUT				0xFFFF
 #define OF_UDP_DEFAULT_TIMEOUT	NO_TIMEOUT
 
+/// Hint to the CPU that we are in a spin-wait loop.
+#if defined(TARGET_WIN32)
+	#define HXUDP_CPU_RELAX() YieldProcessor()
+#elif defined(__i386__) || defined(__x86_64__)
+	#define HXUDP_CPU_RELAX() __asm__ __volatile__("pause")
+#elif defined(__aarch64__) || defined(__arm__)
+	#define HXUDP_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+	#define HXUDP_CPU_RELAX() do {} while (0)
+#endif
+
+/// IPv4 + UDP header bytes, and the largest payload a single UDP/IPv4 datagram can carry.
+#define UDP_IP_HEADER_SIZE		28
+#define UDP_MAX_PAYLOAD			65507
+
+/// Path MTU assumed for message fragmentation when the kernel cannot tell us (Ethernet).
+#define DEFAULT_PATH_MTU		1500
+
+/// sendMessage()/receiveMessage() framing.
+#define FRAG_MAGIC				0x4846	// "HF"
+#define FRAG_HEADER_SIZE		16
+#define FRAG_MIN_PAYLOAD		64
+
+/// sendCoalesced()/receiveCoalesced() framing: magic, then a 2 byte length before every message.
+#define COALESCE_MAGIC			0x4843	// "HC"
+#define COALESCE_HEADER_SIZE	2
+#define COALESCE_LENGTH_SIZE	2
+
+/// Flushed coalescing buffers kept for reuse; the rest are freed.
+#define COALESCE_SPARE_BUFFERS	16
+
+/// Idle-expiry timer wheel of the peer table; a peer's deadline always falls within half a turn.
+#define PEER_WHEEL_SLOTS		256
+
+/// Smallest datagram sent with MSG_ZEROCOPY. Below this, page pinning costs more than the copy,
+/// and hxcpp may still place the buffer in its moving small-object heap.
+#define ZEROCOPY_MIN_SIZE		(16 * 1024)
+
+/// Milliseconds a closing socket waits for the kernel to release its zero-copy buffers.
+#define ZEROCOPY_DRAIN_TIMEOUT	1000
+
+/// Largest demux lookup table, i.e. the number of distinct header keys.
+#define DEMUX_MAX_KEYS			65536
+
+/// pcap capture files written by the recorder: raw IPv4 link type, microsecond timestamps.
+#define PCAP_MAGIC				0xa1b2c3d4
+#define PCAP_MAGIC_SWAPPED		0xd4c3b2a1
+#define PCAP_MAGIC_NANO			0xa1b23c4d
+#define PCAP_MAGIC_NANO_SWAPPED	0x4d3cb2a1
+#define PCAP_HEADER_SIZE		24
+#define PCAP_RECORD_HEADER_SIZE	16
+#define PCAP_LINKTYPE_ETHERNET	1
+#define PCAP_LINKTYPE_RAW		101
+#define PCAP_LINKTYPE_IPV4		228
+#define PCAP_DEFAULT_CAPACITY	(64 * 1024 * 1024)
+
+/// Directions of the network impairment layer, and its latency jitter distributions.
+#define IMPAIR_SEND				0
+#define IMPAIR_RECEIVE			1
+#define IMPAIR_JITTER_UNIFORM	0
+#define IMPAIR_JITTER_NORMAL	1
+
+/// Max datagrams held by each direction of the impairment layer; more are lost as overflow.
+#define IMPAIR_QUEUE_LIMIT		4096
+
+/// Max bytes held by the software pacer before Send() starts failing with ENOBUFS.
+#define PACING_QUEUE_LIMIT		(4 * 1024 * 1024)
+
 using namespace std;
 
 template < class T >
@@ -146,6 +230,165 @@ void ofxNetworkCheckError(){
 	}
 }
 
+/**
+ * Monotonic time in microseconds.
+ * On Linux this is CLOCK_MONOTONIC, which is also the clock SO_TXTIME is configured with.
+ */
+long long hxudpGetMicros(){
+	#ifdef TARGET_WIN32
+		static LARGE_INTEGER freq;
+		if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return (long long)(now.QuadPart / freq.QuadPart) * 1000000LL
+			+ (long long)(now.QuadPart % freq.QuadPart) * 1000000LL / freq.QuadPart;
+	#elif defined(CLOCK_MONOTONIC)
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+	#else
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
+	#endif
+}
+
+void hxudpSetError(int err){
+	#ifdef TARGET_WIN32
+		WSASetLastError(err);
+	#else
+		errno = err;
+	#endif
+}
+
+/**
+ * True if the last socket call failed only because it would have blocked.
+ */
+bool hxudpWouldBlock(){
+	#ifdef TARGET_WIN32
+		int err = WSAGetLastError();
+		return err == WSAEWOULDBLOCK || err == EAGAIN;
+	#else
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	#endif
+}
+
+/**
+ * True if the last socket call failed because the datagram exceeded the path MTU.
+ */
+bool hxudpMsgTooBig(){
+	#ifdef TARGET_WIN32
+		int err = WSAGetLastError();
+		return err == WSAEMSGSIZE || err == EMSGSIZE;
+	#else
+		return errno == EMSGSIZE;
+	#endif
+}
+
+/**
+ * Pins the calling thread to one CPU, or lets it run anywhere again with -1.
+ */
+bool hxudpPinThreadToCpu(int cpu){
+	#if defined(__linux__)
+		// affinity the thread had before its first pin, put back by unpinning
+		static __thread cpu_set_t original;
+		static __thread bool pinned = false;
+
+		if (cpu < 0) {
+			if (!pinned) return true;
+			if (sched_setaffinity(0, sizeof(original), &original) != 0) return false;
+			pinned = false;
+			return true;
+		}
+		if (cpu >= CPU_SETSIZE) return false;
+		if (!pinned && sched_getaffinity(0, sizeof(original), &original) != 0) return false;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) != 0) return false;
+		pinned = true;
+		return true;
+	#elif defined(TARGET_WIN32)
+		if (cpu >= (int)(sizeof(DWORD_PTR) * 8)) return false;
+
+		DWORD_PTR mask, system;
+		if (cpu < 0) {
+			if (!GetProcessAffinityMask(GetCurrentProcess(), &mask, &system)) return false;
+		} else {
+			mask = (DWORD_PTR)1 << cpu;
+		}
+		return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+	#else
+		return false;
+	#endif
+}
+
+/**
+ * CPU the calling thread is running on, -1 if unknown.
+ */
+int hxudpGetCurrentCpu(){
+	#if defined(__linux__)
+		return sched_getcpu();
+	#elif defined(TARGET_WIN32)
+		return (int)GetCurrentProcessorNumber();
+	#else
+		return -1;
+	#endif
+}
+
+/**
+ * Number of CPUs configured in the system.
+ */
+int hxudpGetCpuCount(){
+	#ifdef TARGET_WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return (int)info.dwNumberOfProcessors;
+	#else
+		long n = sysconf(_SC_NPROCESSORS_CONF);
+		return n > 0 ? (int)n : 1;
+	#endif
+}
+
+/**
+ * NUMA node a CPU belongs to, read from sysfs. -1 if unknown.
+ */
+int hxudpGetCpuNumaNode(int cpu){
+	#if defined(__linux__)
+		if (cpu < 0) return -1;
+
+		string path = "/sys/devices/system/cpu/cpu" + ofToString(cpu);
+		DIR* dir = opendir(path.c_str());
+		if (dir == NULL) return -1;
+
+		int node = -1;
+		struct dirent* entry;
+		while ((entry = readdir(dir)) != NULL) {
+			if (strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char)entry->d_name[4])) {
+				node = atoi(entry->d_name + 4);
+				break;
+			}
+		}
+		closedir(dir);
+		return node;
+	#else
+		return -1;
+	#endif
+}
+
+void hxudpSleepMicros(long long micros){
+	if (micros <= 0) return;
+	#ifdef TARGET_WIN32
+		Sleep((DWORD)((micros + 999) / 1000));
+	#else
+		struct timespec ts;
+		ts.tv_sec = (time_t)(micros / 1000000LL);
+		ts.tv_nsec = (long)(micros % 1000000LL) * 1000;
+		while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+	#endif
+}
+
 
 //////////////////////////////////////////////////////////////////////////////////////
 // Original author: ???????? we think Christian Naglhofer
@@ -211,6 +454,554 @@ x) Close()
 --------------------------------------------------------------------------------*/
 
 
+/// A datagram held back by the software pacer until its departure time.
+struct PacedDatagram
+{
+	vector<char> data;
+	struct sockaddr_in addr;
+	long long due;
+};
+
+struct PacingStats
+{
+	int sent;			// datagrams put on the wire by the pacer
+	int delayed;		// datagrams that had to wait in the queue
+	int dropped;		// datagrams rejected because the queue was full, or discarded by Close()
+	int queued;			// datagrams currently waiting
+	int queuedBytes;	// bytes currently waiting
+};
+
+struct BusyPollStats
+{
+	double spinMicros;	// time spent spinning on a non-blocking recvfrom in user space
+	double sleepMicros;	// time spent in a blocking recvfrom after the spin budget ran out, or in any recvfrom in kernel mode
+	int spinHits;		// datagrams received while spinning in user space
+	int sleepHits;		// datagrams received after falling back to a blocking wait, or by any recvfrom in kernel mode
+	int budget;			// current adaptive spin budget in microseconds
+	bool kernel;		// SO_BUSY_POLL was accepted; the kernel spins instead and only the waits are measured
+};
+
+/**
+ * One message being put back together by ReceiveMessage().
+ * Buffers are allocated once by SetReassembly() and reused.
+ */
+struct ReassemblySlot
+{
+	bool used;
+	unsigned long addr;		// sender, network byte order
+	unsigned short port;
+	unsigned long msgId;
+	int count;				// fragments expected
+	int received;			// fragments seen so far
+	int totalLength;
+	long long lastUpdate;
+	vector<char> data;
+	vector<unsigned char> bitmap;
+};
+
+struct FragmentStats
+{
+	int messagesSent;
+	int fragmentsSent;
+	int completed;		// messages reassembled and delivered
+	int expired;		// partial messages dropped after the timeout
+	int evicted;		// partial messages dropped to make room in a full table
+	int duplicates;		// fragments received twice
+	int invalid;		// datagrams without a valid fragment header, or too large for the table
+};
+
+/// Small messages waiting to go out to one destination as a single datagram.
+struct CoalesceBuffer
+{
+	struct sockaddr_in addr;
+	vector<char> data;
+	int used;
+	int count;
+	long long deadline;
+};
+
+struct CoalesceStats
+{
+	int messages;		// messages handed to SendCoalesced()
+	int datagrams;		// datagrams they went out in
+	int flushFull;		// flushes because the next message did not fit
+	int flushDeadline;	// flushes because the deadline passed
+	int flushExplicit;	// flushes requested with FlushCoalesced()
+	int discarded;		// pending messages lost because Close() was called before they were flushed
+};
+
+/// A remote endpoint tracked by the peer table; its index is the peer id.
+struct Peer
+{
+	bool active;
+	unsigned long long key;		// address << 16 | port
+	struct sockaddr_in addr;
+	long long lastSeen;			// milliseconds
+	int wheelNext;				// next peer in the same timer wheel slot, -1 ends the list
+};
+
+struct PeerStats
+{
+	int active;		// peers currently in the table
+	int created;	// peers ever added
+	int expired;	// peers dropped for being idle
+	int rejected;	// datagrams from new senders while the table was full
+};
+
+/// A buffer handed to the kernel by reference, waiting for its completion notification.
+struct ZeroCopyPending
+{
+	unsigned int id;
+	void* token;	// owned by the caller, given back by PollZeroCopy()
+};
+
+struct ZeroCopyStats
+{
+	int sent;			// datagrams sent by reference
+	int copied;			// datagrams copied because they were small or zero-copy was unavailable
+	int completed;		// completions received
+	int kernelCopied;	// completions where the kernel ended up copying anyway (e.g. loopback)
+	int pending;		// buffers still owned by the kernel
+};
+
+/// Fixed-size ring of datagrams routed to one demux channel.
+struct DemuxQueue
+{
+	int slotSize;
+	int head;
+	int count;
+	vector<char> data;				// slots * slotSize
+	vector<int> lengths;
+	vector<struct sockaddr_in> senders;
+};
+
+struct DemuxStats
+{
+	int routed;		// datagrams queued on a channel
+	int unrouted;	// datagrams dropped for a short header, an unknown key or an unsubscribed channel
+	int overflow;	// datagrams dropped because their channel queue was full
+	int truncated;	// datagrams cut to the channel's slot size
+};
+
+/**
+ * Appends datagrams to a pcap file through a shared memory mapping, so recording a packet costs
+ * one memcpy. The mapping doubles when full; the file is cut to its real length on Close().
+ * Windows writes through stdio instead.
+ * Each datagram is stored with synthesized IPv4/UDP headers so the capture opens in Wireshark.
+ */
+class PcapRecorder
+{
+public:
+	PcapRecorder() {
+		m_pMap = NULL;
+		m_pFile = NULL;
+		m_iFd = -1;
+		m_llCapacity = 0;
+		m_llUsed = 0;
+		m_iRecords = 0;
+	}
+
+	~PcapRecorder() {
+		Close();
+	}
+
+	bool IsOpen() {
+		return m_pMap != NULL || m_pFile != NULL;
+	}
+
+	bool Open(const char* path, long long capacity) {
+		Close();
+		if (capacity < PCAP_HEADER_SIZE) capacity = PCAP_DEFAULT_CAPACITY;
+
+		unsigned char header[PCAP_HEADER_SIZE];
+		unsigned int u32;
+		unsigned short u16;
+		u32 = PCAP_MAGIC;				memcpy(header, &u32, 4);
+		u16 = 2;						memcpy(header + 4, &u16, 2);
+		u16 = 4;						memcpy(header + 6, &u16, 2);
+		u32 = 0;						memcpy(header + 8, &u32, 4);	// thiszone
+										memcpy(header + 12, &u32, 4);	// sigfigs
+		u32 = 65535;					memcpy(header + 16, &u32, 4);	// snaplen
+		u32 = PCAP_LINKTYPE_RAW;		memcpy(header + 20, &u32, 4);
+
+		#ifdef TARGET_WIN32
+			m_pFile = fopen(path, "wb");
+			if (m_pFile == NULL) return false;
+			fwrite(header, 1, PCAP_HEADER_SIZE, m_pFile);
+		#else
+			m_iFd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (m_iFd == -1) return false;
+			if (!Map(capacity)) {
+				close(m_iFd);
+				m_iFd = -1;
+				return false;
+			}
+			memcpy(m_pMap, header, PCAP_HEADER_SIZE);
+		#endif
+		m_llUsed = PCAP_HEADER_SIZE;
+		m_iRecords = 0;
+		return true;
+	}
+
+	/**
+	 * Appends one datagram received from `from` on the local address `to`.
+	 */
+	bool Record(const char* pBuff, const int iSize, const sockaddr_in& from, const sockaddr_in& to) {
+		if (!IsOpen()) return false;
+
+		int len = 20 + 8 + iSize;
+		long long need = PCAP_RECORD_HEADER_SIZE + len;
+
+		#ifdef TARGET_WIN32
+			unsigned char record[PCAP_RECORD_HEADER_SIZE + 28];
+			unsigned char* out = record;
+		#else
+			if (m_llUsed + need > m_llCapacity) {
+				long long capacity = m_llCapacity;
+				while (m_llUsed + need > capacity) capacity *= 2;
+				if (!Map(capacity)) return false;
+			}
+			unsigned char* out = m_pMap + m_llUsed;
+		#endif
+
+		// wall clock for the capture, like tcpdump
+		#ifdef TARGET_WIN32
+			FILETIME ft;
+			GetSystemTimeAsFileTime(&ft);
+			unsigned long long t = (((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime) / 10 - 11644473600000000ULL;
+			unsigned int tsSec = (unsigned int)(t / 1000000ULL), tsUsec = (unsigned int)(t % 1000000ULL);
+		#else
+			struct timeval tv;
+			gettimeofday(&tv, NULL);
+			unsigned int tsSec = (unsigned int)tv.tv_sec, tsUsec = (unsigned int)tv.tv_usec;
+		#endif
+		unsigned int u32;
+		memcpy(out, &tsSec, 4);
+		memcpy(out + 4, &tsUsec, 4);
+		u32 = len;	memcpy(out + 8, &u32, 4);
+		memcpy(out + 12, &u32, 4);
+
+		unsigned char* ip = out + PCAP_RECORD_HEADER_SIZE;
+		memset(ip, 0, 28);
+		ip[0] = 0x45;
+		ip[2] = (len >> 8) & 0xFF;	ip[3] = len & 0xFF;
+		ip[6] = 0x40;					// don't fragment
+		ip[8] = 64;						// ttl
+		ip[9] = IPPROTO_UDP;
+		memcpy(ip + 12, &from.sin_addr.s_addr, 4);
+		memcpy(ip + 16, &to.sin_addr.s_addr, 4);
+		unsigned long sum = 0;
+		for (int i = 0; i < 20; i += 2) sum += (ip[i] << 8) | ip[i + 1];
+		while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+		ip[10] = (~sum >> 8) & 0xFF;	ip[11] = ~sum & 0xFF;
+
+		unsigned char* udp = ip + 20;
+		memcpy(udp, &from.sin_port, 2);
+		memcpy(udp + 2, &to.sin_port, 2);
+		udp[4] = ((8 + iSize) >> 8) & 0xFF;	udp[5] = (8 + iSize) & 0xFF;
+
+		#ifdef TARGET_WIN32
+			fwrite(record, 1, PCAP_RECORD_HEADER_SIZE + 28, m_pFile);
+			if (iSize > 0) fwrite(pBuff, 1, iSize, m_pFile);
+		#else
+			if (iSize > 0) memcpy(udp + 8, pBuff, iSize);
+		#endif
+		m_llUsed += need;
+		m_iRecords++;
+		return true;
+	}
+
+	/**
+	 * Finishes the file. Returns the number of datagrams recorded.
+	 */
+	int  Close() {
+		int records = m_iRecords;
+		#ifdef TARGET_WIN32
+			if (m_pFile) fclose(m_pFile);
+			m_pFile = NULL;
+		#else
+			if (m_pMap) munmap(m_pMap, (size_t)m_llCapacity);
+			m_pMap = NULL;
+			if (m_iFd != -1) {
+				if (ftruncate(m_iFd, (off_t)m_llUsed) != 0) ofxNetworkCheckError();
+				close(m_iFd);
+			}
+			m_iFd = -1;
+		#endif
+		m_llCapacity = 0;
+		m_llUsed = 0;
+		m_iRecords = 0;
+		return records;
+	}
+
+protected:
+	#ifndef TARGET_WIN32
+	bool Map(long long capacity) {
+		if (m_pMap) munmap(m_pMap, (size_t)m_llCapacity);
+		m_pMap = NULL;
+
+		if (ftruncate(m_iFd, (off_t)capacity) != 0) {
+			ofxNetworkCheckError();
+			return false;
+		}
+		void* map = mmap(NULL, (size_t)capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_iFd, 0);
+		if (map == MAP_FAILED) {
+			ofxNetworkCheckError();
+			return false;
+		}
+		m_pMap = (unsigned char*)map;
+		m_llCapacity = capacity;
+		return true;
+	}
+	#endif
+
+	unsigned char* m_pMap;
+	FILE* m_pFile;
+	int m_iFd;
+	long long m_llCapacity;
+	long long m_llUsed;
+	int m_iRecords;
+};
+
+struct ImpairmentConfig
+{
+	unsigned int seed;		// PRNG seed; the same seed and traffic give the same outcome
+	double dropRate;		// probability that a datagram is lost
+	double duplicateRate;	// probability that a datagram is delivered twice
+	double reorderRate;		// probability that a datagram skips the latency and overtakes those queued before it
+	int delayMicros;		// fixed one-way latency
+	int jitterMicros;		// spread of the latency: half-width when uniform, standard deviation when normal
+	int jitterDistribution;	// IMPAIR_JITTER_*
+	int bandwidth;			// link rate in bytes per second, 0 for unlimited
+};
+
+struct ImpairmentStats
+{
+	int passed;		// datagrams delivered, including duplicates
+	int dropped;	// datagrams lost on purpose
+	int duplicated;	// extra copies made
+	int reordered;	// datagrams that skipped the latency
+	int overflow;	// datagrams lost because the queue was full
+	int queued;		// datagrams waiting for their release time
+};
+
+/// A datagram held by the impairment layer until its release time.
+struct ImpairedDatagram
+{
+	long long due;
+	unsigned int seq;	// breaks ties between equal release times in arrival order
+	int slot;			// buffer in NetworkImpairment::m_vPool
+	int length;
+	struct sockaddr_in addr;
+};
+
+/**
+ * Emulates a bad link in process, the way netem does on a qdisc. Each datagram is first
+ * serialized at the link rate, then held for the latency plus jitter; a reordered one skips
+ * the latency. Drop, duplicate and reorder decisions and the jitter come from a seeded
+ * xorshift64* generator, so a test sees the same losses on every run.
+ * Held datagrams live in a min-heap ordered by release time, their payloads in a reused pool.
+ */
+class NetworkImpairment
+{
+public:
+	NetworkImpairment() {
+		memset(&m_config, 0, sizeof(m_config));
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_bEnabled = false;
+		m_ullRng = 1;
+		m_llLinkFree = 0;
+		m_uSeq = 0;
+	}
+
+	/**
+	 * Applies a new config and reseeds the generator. Counters restart, held datagrams are kept.
+	 */
+	void Configure(const ImpairmentConfig& config) {
+		m_config = config;
+		m_bEnabled = config.dropRate > 0 || config.duplicateRate > 0 || config.reorderRate > 0
+			|| config.delayMicros > 0 || config.jitterMicros > 0 || config.bandwidth > 0;
+
+		// splitmix64, so that nearby seeds give unrelated sequences and 0 is a valid seed
+		unsigned long long z = config.seed + 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z ^= z >> 31;
+		m_ullRng = z != 0 ? z : 1;
+		m_llLinkFree = 0;
+
+		int queued = m_stats.queued;
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_stats.queued = queued;
+	}
+
+	/**
+	 * Turns the layer off and drops the datagrams it holds, counting them as dropped.
+	 */
+	void Reset() {
+		memset(&m_config, 0, sizeof(m_config));
+		m_bEnabled = false;
+		m_llLinkFree = 0;
+		for (size_t i = 0; i < m_vHeap.size(); i++)
+			m_vFree.push_back(m_vHeap[i].slot);
+		m_stats.dropped += (int)m_vHeap.size();
+		m_stats.queued = 0;
+		m_vHeap.clear();
+	}
+
+	/**
+	 * True while configured, and after that until the held datagrams are all released.
+	 */
+	bool IsActive() const {
+		return m_bEnabled || !m_vHeap.empty();
+	}
+
+	/**
+	 * Runs one datagram through the link at time now.
+	 * Returns how many copies (at most maxImmediate) are due right away; the caller delivers those
+	 * from pBuff itself. The others are dropped or held, and come out of Pop() later.
+	 */
+	int  Admit(const char* pBuff, const int iSize, const sockaddr_in& addr, long long now, int maxImmediate) {
+		if (Chance(m_config.dropRate)) {
+			m_stats.dropped++;
+			return 0;
+		}
+
+		int copies = 1;
+		if (Chance(m_config.duplicateRate)) {
+			m_stats.duplicated++;
+			copies = 2;
+		}
+
+		int immediate = 0;
+		for (int i = 0; i < copies; i++) {
+			long long due = now;
+			if (m_config.bandwidth > 0) {
+				if (m_llLinkFree > due) due = m_llLinkFree;
+				due += (long long)iSize * 1000000LL / m_config.bandwidth;
+				m_llLinkFree = due;
+			}
+			if (Chance(m_config.reorderRate))
+				m_stats.reordered++;
+			else
+				due += SampleLatency();
+
+			if (due <= now && immediate < maxImmediate) {
+				immediate++;
+				continue;
+			}
+			if ((int)m_vHeap.size() >= IMPAIR_QUEUE_LIMIT) {
+				m_stats.overflow++;
+				continue;
+			}
+
+			ImpairedDatagram d;
+			d.due = due;
+			d.seq = m_uSeq++;
+			d.length = iSize;
+			d.addr = addr;
+			if (m_vFree.empty()) {
+				d.slot = (int)m_vPool.size();
+				m_vPool.push_back(vector<char>());
+			} else {
+				d.slot = m_vFree.back();
+				m_vFree.pop_back();
+			}
+			m_vPool[d.slot].assign(pBuff, pBuff + iSize);
+			m_vHeap.push_back(d);
+			push_heap(m_vHeap.begin(), m_vHeap.end(), Later());
+			m_stats.queued++;
+		}
+
+		m_stats.passed += immediate;
+		return immediate;
+	}
+
+	/**
+	 * Copies the earliest datagram due by now into pBuff, truncated to iSize.
+	 * Returns its length, or -1 if none is due.
+	 */
+	int  Pop(long long now, char* pBuff, const int iSize, sockaddr_in& addr) {
+		if (m_vHeap.empty() || m_vHeap.front().due > now) return -1;
+
+		pop_heap(m_vHeap.begin(), m_vHeap.end(), Later());
+		ImpairedDatagram d = m_vHeap.back();
+		m_vHeap.pop_back();
+
+		int n = d.length < iSize ? d.length : iSize;
+		if (n > 0) memcpy(pBuff, &m_vPool[d.slot][0], n);
+		addr = d.addr;
+		m_vFree.push_back(d.slot);
+		m_stats.queued--;
+		m_stats.passed++;
+		return n;
+	}
+
+	/**
+	 * Microseconds from now until the next held datagram is due, or -1 if none is held.
+	 */
+	int  GetDelay(long long now) const {
+		if (m_vHeap.empty()) return -1;
+
+		long long delay = m_vHeap.front().due - now;
+		return delay > 0 ? (int)delay : 0;
+	}
+
+	ImpairmentStats GetStats() const {
+		return m_stats;
+	}
+
+private:
+	struct Later {
+		bool operator()(const ImpairedDatagram& a, const ImpairedDatagram& b) const {
+			return a.due != b.due ? a.due > b.due : (int)(a.seq - b.seq) > 0;
+		}
+	};
+
+	/**
+	 * Uniform in [0, 1).
+	 */
+	double NextDouble() {
+		m_ullRng ^= m_ullRng >> 12;
+		m_ullRng ^= m_ullRng << 25;
+		m_ullRng ^= m_ullRng >> 27;
+		return (double)((m_ullRng * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+	}
+
+	/**
+	 * Draws only when the rate is set, so turning one knob does not shift the others' sequences.
+	 */
+	bool Chance(double rate) {
+		return rate > 0 && NextDouble() < rate;
+	}
+
+	long long SampleLatency() {
+		double latency = m_config.delayMicros;
+		if (m_config.jitterMicros > 0) {
+			if (m_config.jitterDistribution == IMPAIR_JITTER_NORMAL) {
+				// Box-Muller
+				double u = 1.0 - NextDouble();
+				double v = NextDouble();
+				latency += m_config.jitterMicros * sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v);
+			} else {
+				latency += m_config.jitterMicros * (2.0 * NextDouble() - 1.0);
+			}
+		}
+		return latency > 0 ? (long long)latency : 0;
+	}
+
+	ImpairmentConfig m_config;
+	ImpairmentStats m_stats;
+	bool m_bEnabled;
+	unsigned long long m_ullRng;
+	long long m_llLinkFree;
+	unsigned int m_uSeq;
+	vector<ImpairedDatagram> m_vHeap;
+	vector< vector<char> > m_vPool;
+	vector<int> m_vFree;
+};
+
+
 class UdpSocket
 {
 public:
@@ -230,11 +1021,54 @@ public:
 
 		m_hSocket= INVALID_SOCKET;
 		m_dwTimeoutReceive=	OF_UDP_DEFAULT_TIMEOUT;
+		memset(&saServer, 0, sizeof(sockaddr_in));
+		memset(&saClient, 0, sizeof(sockaddr_in));
 		m_iListenPort= -1;
 
 		canGetRemoteAddress	= false;
-		nonBlocking			= true;
-
+		nonBlocking			= false;
+
+		m_iPacingBytesPerSec	= 0;
+		m_iPacingPacketsPerSec	= 0;
+		m_bTxTime				= false;
+		m_llPaceNext			= 0;
+		memset(&m_pacingStats, 0, sizeof(m_pacingStats));
+
+		m_iSpinMicros			= 0;
+		memset(&m_busyPollStats, 0, sizeof(m_busyPollStats));
+
+		m_iFragmentSize			= 0;
+		m_iFragPayload			= 0;
+		m_ulNextMsgId			= 0;
+		m_iReassemblyMaxSize	= 0;
+		m_iReassemblyTimeout	= 0;
+		memset(&m_fragmentStats, 0, sizeof(m_fragmentStats));
+
+		m_bCoalescing			= false;
+		m_iCoalesceSize			= 0;
+		m_iCoalesceDeadline		= 0;
+		m_iCoalescePathSize		= 0;
+		m_ullCoalescePathKey	= 0;
+		memset(&m_coalesceStats, 0, sizeof(m_coalesceStats));
+
+		m_iPeerId				= -1;
+		m_iPeerIdleMs			= 0;
+		m_iPeerTickMs			= 1;
+		m_llPeerTick			= 0;
+		memset(&m_peerStats, 0, sizeof(m_peerStats));
+
+		m_bZeroCopy				= false;
+		m_iZeroCopyThreshold	= ZEROCOPY_MIN_SIZE;
+		m_uZeroCopyNext			= 0;
+		memset(&m_zeroCopyStats, 0, sizeof(m_zeroCopyStats));
+
+		m_iDemuxOffset			= 0;
+		m_iDemuxWidth			= 0;
+		m_uDemuxMask			= 0;
+		m_iDemuxShift			= 0;
+		memset(&m_demuxStats, 0, sizeof(m_demuxStats));
+
+		memset(&m_saLocal, 0, sizeof(m_saLocal));
 	}
 
 	virtual ~UdpSocket() {
@@ -260,6 +1094,30 @@ public:
 		}
 		m_hSocket= INVALID_SOCKET;
 
+		// datagrams still waiting for the pacer can no longer go out
+		m_pacingStats.dropped += m_pacingStats.queued;
+		m_pacingStats.queued = 0;
+		m_pacingStats.queuedBytes = 0;
+		m_qPaced.clear();
+		m_llPaceNext = 0;
+		m_bTxTime = false;
+
+		// nor can messages still waiting to be coalesced
+		for (size_t i = 0; i < m_vCoalesce.size(); i++)
+			m_coalesceStats.discarded += m_vCoalesce[i].count;
+		m_vCoalesce.clear();
+		m_mCoalesceIndex.clear();
+
+		// zero-copy is per socket and the kernel numbers completions from 0 on each one
+		m_bZeroCopy = false;
+		m_uZeroCopyNext = 0;
+		m_qZeroCopy.clear();
+		memset(&m_zeroCopyStats, 0, sizeof(m_zeroCopyStats));
+
+		// held datagrams would otherwise come out of the next socket
+		m_sendImpairment.Reset();
+		m_recvImpairment.Reset();
+
 		return(true);
 	}
 
@@ -298,6 +1156,8 @@ public:
 
 	    memset(&(saClient.sin_zero), '\0', 8);  // zero the rest of the struct
 
+		// the fragment size was sized for the previous destination's path
+		m_iFragPayload = 0;
 
 		return true;
 	}
@@ -387,9 +1247,7 @@ public:
 			}
 		}*/
 
-		int ret = sendto(m_hSocket, (char*)pBuff,	iSize, 0, (sockaddr *)&saClient, sizeof(sockaddr));
-		if(ret==-1) ofxNetworkCheckError();
-		return ret;
+		return SendTo(pBuff, iSize, saClient);
 		//	return(send(m_hSocket, pBuff, iSize, 0));
 	}
 
@@ -422,10 +1280,9 @@ public:
 
 		while (total < iSize)
 		{
-			n =	sendto(m_hSocket, (char*)pBuff,	iSize, 0, (sockaddr *)&saClient, sizeof(sockaddr));
+			n =	SendTo(pBuff + total, bytesleft, saClient);
 			if (n == -1)
 				{
-					ofxNetworkCheckError();
 					break;
 				}
 			total += n;
@@ -459,27 +1316,23 @@ public:
 			}
 		}*/
 
-		#ifndef TARGET_WIN32
-			socklen_t nLen= sizeof(sockaddr);
-		#else
-			int	nLen= sizeof(sockaddr);
-		#endif
-
 		int	ret=0;
 
 		memset(pBuff, 0, iSize);
-		ret= recvfrom(m_hSocket, pBuff,	iSize, 0, (sockaddr *)&saClient, &nLen);
+		ret= ReceiveDatagram(pBuff, iSize, saClient);
 
 		if (ret	> 0)
 		{
 					//printf("\nreceived from: %s\n",	inet_ntoa((in_addr)saClient.sin_addr));
 			canGetRemoteAddress= true;
+			m_iPeerId= TrackPeer(saClient);
 		}
 		else
 		{
 			ofxNetworkCheckError();
 					//printf("\nreceived from: ????\n");
 			canGetRemoteAddress= false;
+			m_iPeerId= -1;
 		}
 
 		return ret;
@@ -615,65 +1468,1847 @@ public:
 		return ret;
 	}
 
+	/**
+	 * Largest payload a single datagram to the current destination can carry.
+	 * Derived from the path MTU where the OS reports one, UDP_MAX_PAYLOAD otherwise.
+	 */
 	int  GetMaxMsgSize() {
 		if (m_hSocket == INVALID_SOCKET) return(false);
 
-		int	sizeBuffer=0;
+		#ifdef TARGET_WIN32
+			int	sizeBuffer=0;
+			int size = sizeof(int);
 
-		#ifndef TARGET_WIN32
+			int ret = getsockopt(m_hSocket, SOL_SOCKET, SO_MAX_MSG_SIZE, (char*)&sizeBuffer, &size);
+			if(ret==-1) ofxNetworkCheckError();
+			return sizeBuffer;
+		#else
+			int mtu = GetPathMtu();
+			if (mtu <= UDP_IP_HEADER_SIZE || mtu - UDP_IP_HEADER_SIZE > UDP_MAX_PAYLOAD)
+				return UDP_MAX_PAYLOAD;
+			return mtu - UDP_IP_HEADER_SIZE;
+		#endif
+	}
+
+	/**
+	 * Sets the DF bit on outgoing datagrams so the kernel learns the path MTU and
+	 * Send() fails with EMSGSIZE instead of letting IP fragment (IP_MTU_DISCOVER).
+	 */
+	bool SetPathMtuDiscovery(bool enable) {
+		if (m_hSocket == INVALID_SOCKET) return(false);
+
+		#if defined(IP_MTU_DISCOVER)
+			int opt = IPPROTO_IP, name = IP_MTU_DISCOVER;
+			int val = enable ? IP_PMTUDISC_DO : IP_PMTUDISC_DONT;
+		#elif defined(IP_DONTFRAG)
+			int opt = IPPROTO_IP, name = IP_DONTFRAG;
+			int val = enable;
+		#elif defined(IP_DONTFRAGMENT)
+			int opt = IPPROTO_IP, name = IP_DONTFRAGMENT;
+			int val = enable;
+		#else
+			hxudpSetError(ENOPROTOOPT);
+			ofxNetworkCheckError();
+			return false;
+		#endif
+
+		#if defined(IP_MTU_DISCOVER) || defined(IP_DONTFRAG) || defined(IP_DONTFRAGMENT)
+			if (setsockopt(m_hSocket, opt, name, (char*)&val, sizeof(val)) == 0){
+				m_iFragPayload = 0;
+				return true;
+			}
+			ofxNetworkCheckError();
+			return false;
+		#endif
+	}
+
+	/**
+	 * Path MTU towards the current destination as cached by the kernel, -1 if unknown.
+	 * IP_MTU only works on connected sockets, so it is read from a throwaway socket
+	 * connected to the same destination.
+	 */
+	int  GetPathMtu() {
+		#if defined(IP_MTU) && !defined(TARGET_WIN32)
+			if (saClient.sin_family != AF_INET) return -1;
+
+			int probe = socket(AF_INET, SOCK_DGRAM, 0);
+			if (probe == INVALID_SOCKET) {
+				ofxNetworkCheckError();
+				return -1;
+			}
+
+			int mtu = -1;
+			socklen_t size = sizeof(int);
+			if (connect(probe, (sockaddr *)&saClient, sizeof(sockaddr)) != 0
+				|| getsockopt(probe, IPPROTO_IP, IP_MTU, (char*)&mtu, &size) != 0)
+				mtu = -1;
+			close(probe);
+			return mtu;
+		#else
+			return -1;
+		#endif
+	}
+
+	/**
+	 * Caps the datagram size SendMessage() produces, header included.
+	 * 0 uses the path MTU (or DEFAULT_PATH_MTU when unknown).
+	 */
+	void SetFragmentSize(int bytes) {
+		m_iFragmentSize = bytes > 0 ? bytes : 0;
+		m_iFragPayload = 0;
+	}
+
+	/**
+	 * Preallocates the table ReceiveMessage() reassembles into: up to `slots` messages from
+	 * different senders in flight at once, each at most maxMessageSize bytes. Partial messages
+	 * older than timeoutMs are dropped (0 never times them out); when the table is full the
+	 * stalest one is evicted.
+	 */
+	void SetReassembly(int slots, int maxMessageSize, int timeoutMs) {
+		if (slots < 1) slots = 1;
+		if (maxMessageSize < 1) maxMessageSize = 1;
+
+		m_iReassemblyMaxSize = maxMessageSize;
+		m_iReassemblyTimeout = timeoutMs > 0 ? timeoutMs : 0;
+
+		int maxFragments = maxMessageSize / FRAG_MIN_PAYLOAD + 1;
+		m_vReassembly.resize(slots);
+		for (int i = 0; i < slots; i++) {
+			ReassemblySlot& slot = m_vReassembly[i];
+			slot.used = false;
+			slot.data.assign(maxMessageSize, 0);
+			slot.bitmap.assign((maxFragments + 7) / 8, 0);
+		}
+		m_vFragRecvBuf.resize(UDP_MAX_PAYLOAD);
+	}
+
+	/**
+	 * Sends a message of any size (up to 65535 fragments) as one or more datagrams that fit the
+	 * path MTU, each prefixed with a FRAG_HEADER_SIZE header. The peer must use ReceiveMessage().
+	 * Return values:
+	 * the message size, or SOCKET_ERROR in case of a problem.
+	 */
+	int  SendMessage(const char* pBuff, const int iSize) {
+		if (m_hSocket == INVALID_SOCKET) return(SOCKET_ERROR);
+
+		for (int attempt = 0; attempt < 2; attempt++) {
+			if (m_iFragPayload == 0) {
+				int datagram = m_iFragmentSize > 0 ? m_iFragmentSize : GetUnfragmentedSize();
+				if (datagram > UDP_MAX_PAYLOAD) datagram = UDP_MAX_PAYLOAD;
+				m_iFragPayload = datagram - FRAG_HEADER_SIZE;
+				if (m_iFragPayload < FRAG_MIN_PAYLOAD) m_iFragPayload = FRAG_MIN_PAYLOAD;
+				m_vFragSendBuf.resize(FRAG_HEADER_SIZE + m_iFragPayload);
+			}
+
+			int payload = m_iFragPayload;
+			int count = iSize > 0 ? (iSize + payload - 1) / payload : 1;
+			if (count > 0xFFFF) {
+				hxudpSetError(EMSGSIZE);
+				ofxNetworkCheckError();
+				return SOCKET_ERROR;
+			}
+
+			unsigned long msgId = m_ulNextMsgId++;
+			char* out = &m_vFragSendBuf[0];
+			int index;
+			for (index = 0; index < count; index++) {
+				int offset = index * payload;
+				int len = iSize - offset < payload ? iSize - offset : payload;
+				WriteFragmentHeader(out, index, count, payload, msgId, iSize);
+				if (len > 0) memcpy(out + FRAG_HEADER_SIZE, pBuff + offset, len);
+
+				if (Send(out, FRAG_HEADER_SIZE + len) == SOCKET_ERROR)
+					break;
+				m_fragmentStats.fragmentsSent++;
+			}
+
+			if (index == count) {
+				m_fragmentStats.messagesSent++;
+				return iSize;
+			}
+			if (!hxudpMsgTooBig())
+				return SOCKET_ERROR;
+
+			// the path MTU shrank under us, start over with a fresh message id
+			m_iFragPayload = 0;
+		}
+		return SOCKET_ERROR;
+	}
+
+	/**
+	 * Receives the next complete message sent with SendMessage(), reassembling fragments as
+	 * they arrive. Datagrams without a valid fragment header are dropped.
+	 * Return values:
+	 * the message size (truncated to iSize if the buffer is too small), or
+	 * SOCKET_ERROR in case of a problem, or when non-blocking and no message is complete yet.
+	 */
+	int  ReceiveMessage(char* pBuff, const int iSize) {
+		if (m_hSocket == INVALID_SOCKET) return(SOCKET_ERROR);
+		if (m_vReassembly.empty()) SetReassembly(16, 256 * 1024, 2000);
+
+		struct sockaddr_in from;
+		for (;;) {
+			int ret = ReceiveDatagram(&m_vFragRecvBuf[0], (int)m_vFragRecvBuf.size(), from);
+			if (ret < 0) {
+				if (!hxudpWouldBlock()) ofxNetworkCheckError();
+				canGetRemoteAddress = false;
+				m_iPeerId = -1;
+				return ret;
+			}
+
+			int len = ReassembleFragment(&m_vFragRecvBuf[0], ret, from, pBuff, iSize);
+			if (len >= 0) {
+				saClient = from;
+				canGetRemoteAddress = true;
+				m_iPeerId = TrackPeer(from);
+				return len;
+			}
+		}
+	}
+
+	FragmentStats GetFragmentStats() {
+		return m_fragmentStats;
+	}
+
+
+	/**
+	 * returns -1 on failure
+	 */
+	int  GetTTL() {
+		if (m_hSocket == INVALID_SOCKET) return(false);
+
+		int nTTL;
+
+		#ifndef TARGET_WIN32
+			socklen_t nSize = sizeof(int);
+		#else
+			int nSize = sizeof(int);
+		#endif
+
+		if (getsockopt(m_hSocket, IPPROTO_IP, IP_MULTICAST_TTL, (char FAR *) &nTTL, &nSize) == SOCKET_ERROR)
+		{
+			#ifdef _DEBUG
+			printf("getsockopt failed! Error: %d", WSAGetLastError());
+			#endif
+			ofxNetworkCheckError();
+			return -1;
+		}
+
+		return nTTL;
+	}
+
+	bool SetTTL(int nTTL) {
+		if (m_hSocket == INVALID_SOCKET) return(false);
+
+		// Set the Time-to-Live of the multicast.
+		if (setsockopt(m_hSocket, IPPROTO_IP, IP_MULTICAST_TTL, (char FAR *)&nTTL, sizeof (int)) == SOCKET_ERROR)
+		{
+			#ifdef _DEBUG
+			printf("setsockopt failed! Error: %d", WSAGetLastError());
+			#endif
+			ofxNetworkCheckError();
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Asks the kernel to cap the socket's transmit rate (SO_MAX_PACING_RATE).
+	 * Only enforced when the egress qdisc is fq. 0 removes the cap.
+	 */
+	bool SetMaxPacingRate(int bytesPerSec) {
+		if (m_hSocket == INVALID_SOCKET) return(false);
+
+		#ifdef SO_MAX_PACING_RATE
+			unsigned int rate = bytesPerSec > 0 ? (unsigned int)bytesPerSec : ~0U;
+			if (setsockopt(m_hSocket, SOL_SOCKET, SO_MAX_PACING_RATE, (char*)&rate, sizeof(rate)) == 0){
+				return true;
+			}
+		#else
+			hxudpSetError(ENOPROTOOPT);
+		#endif
+		ofxNetworkCheckError();
+		return false;
+	}
+
+	/**
+	 * Software pacing of Send(). Either limit may be 0 (unlimited); both 0 turns pacing off
+	 * and releases whatever is still queued.
+	 * Datagrams that are not yet due are copied into a queue and released by PumpPacing(),
+	 * unless SetTxTime(true) succeeded, in which case the departure time is handed to the kernel.
+	 */
+	void SetPacing(int bytesPerSec, int packetsPerSec) {
+		m_iPacingBytesPerSec	= bytesPerSec > 0 ? bytesPerSec : 0;
+		m_iPacingPacketsPerSec	= packetsPerSec > 0 ? packetsPerSec : 0;
+		m_llPaceNext			= 0;
+
+		if (m_iPacingBytesPerSec == 0 && m_iPacingPacketsPerSec == 0) {
+			for (deque<PacedDatagram>::iterator it = m_qPaced.begin(); it != m_qPaced.end(); ++it)
+				it->due = 0;
+			PumpPacing();
+		}
+	}
+
+	/**
+	 * Lets the kernel hold paced datagrams until their departure time (SO_TXTIME, Linux only).
+	 * Off by default. Only the fq and etf qdiscs honour the departure time; any other qdisc sends
+	 * at once, and the kernel accepts the option regardless, so enable it only on such an interface.
+	 * Returns false if unsupported, in which case the software queue keeps being used.
+	 * Cleared by Close().
+	 */
+	bool SetTxTime(bool enable) {
+		if (m_hSocket == INVALID_SOCKET) return(false);
+
+		if (!enable) {
+			m_bTxTime = false;
+			return true;
+		}
+
+		#if defined(SO_TXTIME) && defined(SCM_TXTIME)
+			struct sock_txtime cfg;
+			memset(&cfg, 0, sizeof(cfg));
+			cfg.clockid = CLOCK_MONOTONIC;
+			if (setsockopt(m_hSocket, SOL_SOCKET, SO_TXTIME, (char*)&cfg, sizeof(cfg)) == 0){
+				m_bTxTime = true;
+				return true;
+			}
+		#else
+			hxudpSetError(ENOPROTOOPT);
+		#endif
+		ofxNetworkCheckError();
+		return false;
+	}
+
+	/**
+	 * Sends every queued datagram whose departure time has come.
+	 * Returns the number of datagrams sent.
+	 */
+	int  PumpPacing() {
+		if (m_qPaced.empty()) return 0;
+
+		int sent = 0;
+		long long now = hxudpGetMicros();
+		while (!m_qPaced.empty() && m_qPaced.front().due <= now) {
+			PacedDatagram& d = m_qPaced.front();
+			if (SendDatagram(d.data.empty() ? NULL : &d.data[0], (int)d.data.size(), d.addr, 0) != SOCKET_ERROR)
+				sent++;
+			m_pacingStats.queuedBytes -= (int)d.data.size();
+			m_pacingStats.queued--;
+			m_qPaced.pop_front();
+		}
+		m_pacingStats.sent += sent;
+		return sent;
+	}
+
+	/**
+	 * Microseconds until the next queued datagram is due, or -1 if the queue is empty.
+	 */
+	int  GetPacingDelay() {
+		if (m_qPaced.empty()) return -1;
+
+		long long delay = m_qPaced.front().due - hxudpGetMicros();
+		return delay > 0 ? (int)delay : 0;
+	}
+
+	/**
+	 * Blocks until the pacing queue is empty.
+	 * Returns the number of datagrams sent.
+	 */
+	int  FlushPacing() {
+		int sent = 0;
+		while (!m_qPaced.empty()) {
+			hxudpSleepMicros(GetPacingDelay());
+			sent += PumpPacing();
+		}
+		return sent;
+	}
+
+	PacingStats GetPacingStats() {
+		return m_pacingStats;
+	}
+
+	/**
+	 * Low latency receive mode. With preferKernel, asks the kernel to busy poll the device queue for
+	 * up to spinMicros (SO_BUSY_POLL / SO_PREFER_BUSY_POLL). Otherwise, or when the kernel refuses,
+	 * Receive() spins on a non-blocking recvfrom for an adaptive budget of at most spinMicros before
+	 * falling back to a blocking wait. 0 turns it off.
+	 * Returns true if the kernel accepted busy polling. That only means the option was set: devices
+	 * without NAPI, such as loopback, never spin. As the kernel does not say whether it spun, every
+	 * receive is then counted as a sleep hit with its measured wait, and the spin statistics stay 0.
+	 * The statistics restart on every call.
+	 */
+	bool SetBusyPoll(int spinMicros, bool preferKernel) {
+		if (m_hSocket == INVALID_SOCKET) return(false);
+
+		m_iSpinMicros = spinMicros > 0 ? spinMicros : 0;
+		memset(&m_busyPollStats, 0, sizeof(m_busyPollStats));
+		m_busyPollStats.budget = m_iSpinMicros;
+
+		#ifdef SO_BUSY_POLL
+			int usecs = preferKernel ? m_iSpinMicros : 0;
+			if (setsockopt(m_hSocket, SOL_SOCKET, SO_BUSY_POLL, (char*)&usecs, sizeof(usecs)) == 0) {
+				#ifdef SO_PREFER_BUSY_POLL
+					int prefer = usecs > 0;
+					setsockopt(m_hSocket, SOL_SOCKET, SO_PREFER_BUSY_POLL, (char*)&prefer, sizeof(prefer));
+				#endif
+				m_busyPollStats.kernel = usecs > 0;
+			}
+		#endif
+
+		return m_busyPollStats.kernel;
+	}
+
+	BusyPollStats GetBusyPollStats() {
+		return m_busyPollStats;
+	}
+
+	/**
+	 * Configures SendCoalesced(): messages to the same destination are packed into datagrams of
+	 * up to datagramSize bytes (0 follows the path MTU) and held for at most deadlineMicros
+	 * (0 waits until full or flushed). A negative datagramSize turns coalescing off: messages then
+	 * go out as plain datagrams and ReceiveCoalesced() no longer splits what it receives.
+	 * Changing the settings flushes what is pending and measures the path MTU again; otherwise it
+	 * is measured once per destination. Close() discards what is pending.
+	 */
+	void SetCoalescing(int datagramSize, int deadlineMicros) {
+		FlushAllCoalesced();
+		m_bCoalescing = datagramSize >= 0;
+		m_iCoalesceSize = datagramSize > 0 ? datagramSize : 0;
+		if (m_iCoalesceSize > UDP_MAX_PAYLOAD) m_iCoalesceSize = UDP_MAX_PAYLOAD;
+		m_iCoalesceDeadline = deadlineMicros > 0 ? deadlineMicros : 0;
+		m_iCoalescePathSize = 0;
+		m_vCoalesceSpare.clear();
+	}
+
+	/**
+	 * Appends a message to the buffer of the current destination, flushing it first if the message
+	 * does not fit. Messages too large to share a datagram are sent alone, still framed.
+	 * Return values:
+	 * iSize, or SOCKET_ERROR in case of a problem.
+	 */
+	int  SendCoalesced(const char* pBuff, const int iSize) {
+		if (m_hSocket == INVALID_SOCKET) return(SOCKET_ERROR);
+		if (!m_bCoalescing) return SendTo(pBuff, iSize, saClient);
+
+		PumpCoalesced();
+
+		int index = GetCoalesceBuffer(saClient);
+		int capacity = (int)m_vCoalesce[index].data.size();
+		int need = COALESCE_LENGTH_SIZE + iSize;
+
+		if (COALESCE_HEADER_SIZE + need > capacity) {
+			if (iSize > 0xFFFF || COALESCE_HEADER_SIZE + need > UDP_MAX_PAYLOAD) {
+				if (m_vCoalesce[index].count == 0) ReleaseCoalesceBuffer(index);
+				hxudpSetError(EMSGSIZE);
+				ofxNetworkCheckError();
+				return SOCKET_ERROR;
+			}
+			if (FlushCoalesceBuffer(index) == SOCKET_ERROR) return SOCKET_ERROR;
+
+			vector<char> single(COALESCE_HEADER_SIZE + need);
+			WriteCoalesceMessage(&single[0], COALESCE_HEADER_SIZE, pBuff, iSize);
+			m_coalesceStats.messages++;
+			m_coalesceStats.datagrams++;
+			return SendTo(&single[0], (int)single.size(), saClient) == SOCKET_ERROR ? SOCKET_ERROR : iSize;
+		}
+
+		if (m_vCoalesce[index].used + need > capacity) {
+			m_coalesceStats.flushFull++;
+			if (FlushCoalesceBuffer(index) == SOCKET_ERROR) return SOCKET_ERROR;
+			index = GetCoalesceBuffer(saClient);
+		}
+
+		CoalesceBuffer& buf = m_vCoalesce[index];
+		if (buf.count == 0)
+			buf.deadline = m_iCoalesceDeadline > 0 ? hxudpGetMicros() + m_iCoalesceDeadline : 0;
+		WriteCoalesceMessage(&buf.data[0], buf.used, pBuff, iSize);
+		buf.used += need;
+		buf.count++;
+		m_coalesceStats.messages++;
+		return iSize;
+	}
+
+	/**
+	 * Sends whatever is pending for every destination.
+	 * Returns the number of datagrams sent.
+	 */
+	int  FlushCoalesced() {
+		m_coalesceStats.flushExplicit += (int)m_vCoalesce.size();
+		return FlushAllCoalesced();
+	}
+
+	/**
+	 * Sends the buffers whose deadline has passed.
+	 * Returns the number of datagrams sent.
+	 */
+	int  PumpCoalesced() {
+		if (m_iCoalesceDeadline == 0) return 0;
+
+		int sent = 0;
+		long long now = hxudpGetMicros();
+		for (int i = (int)m_vCoalesce.size() - 1; i >= 0; i--) {
+			if (m_vCoalesce[i].deadline > now) continue;
+			m_coalesceStats.flushDeadline++;
+			if (FlushCoalesceBuffer(i) != SOCKET_ERROR) sent++;
+		}
+		return sent;
+	}
+
+	/**
+	 * Microseconds until the earliest pending deadline, or -1 if nothing is waiting on one.
+	 */
+	int  GetCoalesceDelay() {
+		long long earliest = -1;
+		for (size_t i = 0; i < m_vCoalesce.size(); i++) {
+			const CoalesceBuffer& buf = m_vCoalesce[i];
+			if (buf.deadline == 0) continue;
+			if (earliest < 0 || buf.deadline < earliest) earliest = buf.deadline;
+		}
+		if (earliest < 0) return -1;
+
+		long long delay = earliest - hxudpGetMicros();
+		return delay > 0 ? (int)delay : 0;
+	}
+
+	/**
+	 * Receives one datagram and locates the messages packed in it by SendCoalesced() without
+	 * copying them: offsets/lengths into pBuff are written to parts as consecutive pairs.
+	 * A datagram that is not coalesced, or any datagram while coalescing is off on this socket,
+	 * is reported as a single message.
+	 * Return values:
+	 * the number of messages, or SOCKET_ERROR in case of a problem.
+	 */
+	int  ReceiveCoalesced(char* pBuff, const int iSize, vector<int>& parts) {
+		parts.clear();
+		if (m_hSocket == INVALID_SOCKET) return(SOCKET_ERROR);
+
+		int ret = ReceiveDatagram(pBuff, iSize, saClient);
+		if (ret < 0) {
+			if (!hxudpWouldBlock()) ofxNetworkCheckError();
+			canGetRemoteAddress = false;
+			m_iPeerId = -1;
+			return ret;
+		}
+		canGetRemoteAddress = true;
+		m_iPeerId = TrackPeer(saClient);
+
+		if (!m_bCoalescing || SplitCoalesced(pBuff, ret, parts) < 0) {
+			parts.clear();
+			parts.push_back(0);
+			parts.push_back(ret);
+		}
+		return (int)parts.size() / 2;
+	}
+
+	/**
+	 * Parses a coalesced datagram into offset/length pairs.
+	 * Returns the number of messages, or -1 if the datagram is not validly coalesced.
+	 */
+	static int SplitCoalesced(const char* pBuff, const int iLen, vector<int>& parts) {
+		const unsigned char* p = (const unsigned char*)pBuff;
+		if (iLen < COALESCE_HEADER_SIZE || ((p[0] << 8) | p[1]) != COALESCE_MAGIC)
+			return -1;
+
+		int pos = COALESCE_HEADER_SIZE;
+		while (pos < iLen) {
+			if (pos + COALESCE_LENGTH_SIZE > iLen) return -1;
+			int len = (p[pos] << 8) | p[pos + 1];
+			pos += COALESCE_LENGTH_SIZE;
+			if (pos + len > iLen) return -1;
+			parts.push_back(pos);
+			parts.push_back(len);
+			pos += len;
+		}
+		return (int)parts.size() / 2;
+	}
+
+	CoalesceStats GetCoalesceStats() {
+		return m_coalesceStats;
+	}
+
+	/**
+	 * Tracks every sender in a native table so received datagrams can be told apart by a small
+	 * integer id in 0...capacity instead of an address string. Peers silent for idleTimeoutMs
+	 * are dropped (0 keeps them forever). A capacity of 0 turns the table off.
+	 * Ids of expired peers are reused only after PollPeerEvents() reported the expiry.
+	 */
+	void SetPeerTable(int capacity, int idleTimeoutMs) {
+		capacity = capacity > 0 ? capacity : 0;
+		m_iPeerIdleMs = idleTimeoutMs > 0 ? idleTimeoutMs : 0;
+		m_iPeerTickMs = m_iPeerIdleMs / (PEER_WHEEL_SLOTS / 2) + 1;
+		m_llPeerTick = hxudpGetMicros() / 1000 / m_iPeerTickMs;
+
+		int hashSize = 1;
+		while (hashSize < capacity * 2) hashSize <<= 1;
+
+		m_vPeers.assign(capacity, Peer());
+		m_vPeerHash.assign(capacity > 0 ? hashSize : 0, -1);
+		m_vPeerWheel.assign(PEER_WHEEL_SLOTS, -1);
+		m_vPeerFree.clear();
+		for (int id = capacity - 1; id >= 0; id--) {
+			m_vPeers[id].active = false;
+			m_vPeerFree.push_back(id);
+		}
+		m_vNewPeers.clear();
+		m_vExpiredPeers.clear();
+		m_iPeerId = -1;
+		memset(&m_peerStats, 0, sizeof(m_peerStats));
+	}
+
+	/**
+	 * returns the peer id of the last received packet, -1 if unknown or the table is full/off
+	 */
+	int  GetPeerId() {
+		return m_iPeerId;
+	}
+
+	/**
+	 * Expires idle peers, then hands over the peers added and expired since the last call.
+	 * The caller must drain these regularly: ids only return to the free list from here, which
+	 * bounds both lists by the capacity, but also means an undrained table ends up full.
+	 */
+	void PollPeerEvents(vector<int>& newPeers, vector<int>& expiredPeers) {
+		ExpirePeers();
+
+		newPeers.swap(m_vNewPeers);
+		expiredPeers.swap(m_vExpiredPeers);
+		m_vNewPeers.clear();
+		m_vExpiredPeers.clear();
+
+		for (size_t i = 0; i < expiredPeers.size(); i++)
+			m_vPeerFree.push_back(expiredPeers[i]);
+	}
+
+	bool GetPeerAddr(int id, char* address) {
+		if (id < 0 || id >= (int)m_vPeers.size() || !m_vPeers[id].active) return(false);
+
+		inet_ntop(AF_INET, &(m_vPeers[id].addr.sin_addr), address, INET_ADDRSTRLEN);
+		return true;
+	}
+
+	int  GetPeerPort(int id) {
+		if (id < 0 || id >= (int)m_vPeers.size() || !m_vPeers[id].active) return(-1);
+
+		return ntohs(m_vPeers[id].addr.sin_port);
+	}
+
+	/**
+	 * Sends to a peer by id, without touching the address used by Send().
+	 */
+	int  SendToPeer(int id, const char* pBuff, const int iSize) {
+		if (m_hSocket == INVALID_SOCKET) return(SOCKET_ERROR);
+		if (id < 0 || id >= (int)m_vPeers.size() || !m_vPeers[id].active) {
+			hxudpSetError(EADDRNOTAVAIL);
+			ofxNetworkCheckError();
+			return SOCKET_ERROR;
+		}
+
+		return SendTo(pBuff, iSize, m_vPeers[id].addr);
+	}
+
+	PeerStats GetPeerStats() {
+		return m_peerStats;
+	}
+
+	/**
+	 * Enables MSG_ZEROCOPY sends (SO_ZEROCOPY, Linux only) for datagrams of at least
+	 * thresholdBytes, never less than ZEROCOPY_MIN_SIZE. Returns false if unsupported.
+	 * Close() turns it off and resets the statistics; enable it again after Create().
+	 */
+	bool SetZeroCopy(bool enable, int thresholdBytes) {
+		if (m_hSocket == INVALID_SOCKET) return(false);
+
+		m_iZeroCopyThreshold = thresholdBytes > ZEROCOPY_MIN_SIZE ? thresholdBytes : ZEROCOPY_MIN_SIZE;
+
+		#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+			int on = enable;
+			if (setsockopt(m_hSocket, SOL_SOCKET, SO_ZEROCOPY, (char*)&on, sizeof(on)) == 0){
+				m_bZeroCopy = enable;
+				return true;
+			}
+		#else
+			if (!enable) return true;
+			hxudpSetError(ENOPROTOOPT);
+		#endif
+		m_bZeroCopy = false;
+		ofxNetworkCheckError();
+		return false;
+	}
+
+	/**
+	 * True if SendZeroCopy() would send a datagram of this size by reference.
+	 */
+	bool WantsZeroCopy(const int iSize) {
+		return m_bZeroCopy && iSize >= m_iZeroCopyThreshold
+			&& m_iPacingBytesPerSec == 0 && m_iPacingPacketsPerSec == 0
+			&& !m_sendImpairment.IsActive();
+	}
+
+	/**
+	 * Sends to the current destination without copying the buffer into the kernel when
+	 * WantsZeroCopy(iSize). The buffer must then stay untouched until PollZeroCopy() reports
+	 * the returned id; token is handed back along with it.
+	 * Return values:
+	 * a completion id >= 0 when sent by reference,
+	 * ZEROCOPY_COPIED when sent by copy and the buffer can be reused right away,
+	 * SOCKET_ERROR in case of a problem.
+	 */
+	int  SendZeroCopy(const char* pBuff, const int iSize, void* token) {
+		if (m_hSocket == INVALID_SOCKET) return(SOCKET_ERROR);
+
+		#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+		if (WantsZeroCopy(iSize)) {
+			int ret = sendto(m_hSocket, (char*)pBuff, iSize, MSG_ZEROCOPY, (sockaddr *)&saClient, sizeof(sockaddr));
+			if (ret >= 0) {
+				ZeroCopyPending pending;
+				pending.id = m_uZeroCopyNext++;
+				pending.token = token;
+				m_qZeroCopy.push_back(pending);
+				m_zeroCopyStats.sent++;
+				m_zeroCopyStats.pending++;
+				return (int)(pending.id & 0x7FFFFFFF);
+			}
+			// out of optmem for page pinning: copying still works
+			if (errno != ENOBUFS) {
+				ofxNetworkCheckError();
+				return SOCKET_ERROR;
+			}
+		}
+		#endif
+
+		if (SendTo(pBuff, iSize, saClient) == SOCKET_ERROR)
+			return SOCKET_ERROR;
+		m_zeroCopyStats.copied++;
+		return ZEROCOPY_COPIED;
+	}
+
+	/**
+	 * Reads completion notifications off the socket error queue without blocking.
+	 * The ids (as returned by SendZeroCopy()) and tokens of the buffers the kernel released are
+	 * appended to ids/tokens. Returns the number of buffers released.
+	 */
+	int  PollZeroCopy(vector<int>& ids, vector<void*>& tokens) {
+		int released = 0;
+
+		#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+		if (m_hSocket == INVALID_SOCKET || m_qZeroCopy.empty()) return 0;
+
+		char control[128];
+		for (;;) {
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+			if (recvmsg(m_hSocket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+				break;
+
+			for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+				if (cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR) continue;
+
+				struct sock_extended_err serr;
+				memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+				if (serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+				// ee_info..ee_data is an inclusive range of completed ids
+				unsigned int lo = serr.ee_info, hi = serr.ee_data;
+				if (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+					m_zeroCopyStats.kernelCopied += (int)(hi - lo + 1);
+
+				for (deque<ZeroCopyPending>::iterator it = m_qZeroCopy.begin(); it != m_qZeroCopy.end(); ) {
+					if (it->id - lo <= hi - lo) {
+						ids.push_back((int)(it->id & 0x7FFFFFFF));
+						tokens.push_back(it->token);
+						it = m_qZeroCopy.erase(it);
+						released++;
+					} else {
+						++it;
+					}
+				}
+			}
+		}
+
+		m_zeroCopyStats.completed += released;
+		m_zeroCopyStats.pending -= released;
+		#endif
+
+		return released;
+	}
+
+	/**
+	 * Polls until the kernel has released every pending buffer or timeoutMs has passed.
+	 * Completed buffers are reported as by PollZeroCopy(). Returns true if none is left pending.
+	 */
+	bool DrainZeroCopy(int timeoutMs, vector<int>& ids, vector<void*>& tokens) {
+		long long deadline = hxudpGetMicros() + (long long)timeoutMs * 1000LL;
+		for (;;) {
+			PollZeroCopy(ids, tokens);
+			if (m_qZeroCopy.empty()) return true;
+			if (m_hSocket == INVALID_SOCKET || hxudpGetMicros() >= deadline) return false;
+			hxudpSleepMicros(100);
+		}
+	}
+
+	/**
+	 * Forgets every pending buffer and hands back their tokens, for when the socket goes away
+	 * and no more completions will arrive.
+	 */
+	void TakeZeroCopyTokens(vector<void*>& tokens) {
+		for (size_t i = 0; i < m_qZeroCopy.size(); i++)
+			tokens.push_back(m_qZeroCopy[i].token);
+		m_qZeroCopy.clear();
+		m_zeroCopyStats.pending = 0;
+	}
+
+	ZeroCopyStats GetZeroCopyStats() {
+		return m_zeroCopyStats;
+	}
+
+	/**
+	 * Routes received datagrams to per-channel queues by a header field: `width` bytes (1 to 4)
+	 * at `offset`, read big-endian and masked with `mask` (0 keeps every bit). The masked value,
+	 * shifted down to its lowest set bit, is the key looked up with SetDemuxRoute().
+	 * A width of 0 turns demultiplexing off. Returns false if the mask has bits outside the field or
+	 * spans more than DEMUX_MAX_KEYS keys.
+	 * Only ReceiveChannel() and PumpDemux() route; Receive() still returns every datagram in order.
+	 */
+	bool SetDemux(int offset, int width, int mask) {
+		m_iDemuxWidth = 0;
+		m_vDemuxRoutes.clear();
+		memset(&m_demuxStats, 0, sizeof(m_demuxStats));
+		if (width <= 0) return true;
+		if (width > 4 || offset < 0) return false;
+
+		unsigned int field = width == 4 ? 0xFFFFFFFFU : (1U << (width * 8)) - 1;
+		unsigned int m = (unsigned int)mask;
+		if (m == 0) m = field;
+		if (m & ~field) return false;
+		int shift = 0;
+		while (!((m >> shift) & 1)) shift++;
+		if ((m >> shift) >= DEMUX_MAX_KEYS) return false;
+
+		m_iDemuxOffset = offset;
+		m_iDemuxWidth = width;
+		m_uDemuxMask = m;
+		m_iDemuxShift = shift;
+		m_vDemuxRoutes.assign((m >> shift) + 1, -1);
+		if (m_vDemuxQueues.size() > m_vDemuxRoutes.size()) m_vDemuxQueues.resize(m_vDemuxRoutes.size());
+		m_vDemuxRecvBuf.resize(UDP_MAX_PAYLOAD);
+		return true;
+	}
+
+	/**
+	 * Sends datagrams whose key is `key` to `channel`; -1 drops them.
+	 * There are never more channels than keys, so both must be below the key count of SetDemux().
+	 */
+	bool SetDemuxRoute(int key, int channel) {
+		if (key < 0 || key >= (int)m_vDemuxRoutes.size() || channel >= (int)m_vDemuxRoutes.size()) return false;
+
+		m_vDemuxRoutes[key] = channel >= 0 ? channel : -1;
+		return true;
+	}
+
+	/**
+	 * Subscribes to a channel by preallocating its queue of `slots` datagrams of up to slotSize
+	 * bytes each. 0 slots unsubscribes; datagrams routed to it are then dropped.
+	 * Returns false unless SetDemux() is on and channel is below its key count.
+	 */
+	bool SetDemuxChannel(int channel, int slots, int slotSize) {
+		if (channel < 0 || channel >= (int)m_vDemuxRoutes.size()) return false;
+		if (channel >= (int)m_vDemuxQueues.size()) m_vDemuxQueues.resize(channel + 1);
+
+		DemuxQueue& q = m_vDemuxQueues[channel];
+		if (slots < 0) slots = 0;
+		if (slotSize < 0) slotSize = 0;
+		if (slotSize > UDP_MAX_PAYLOAD) slotSize = UDP_MAX_PAYLOAD;
+		q.slotSize = slotSize;
+		q.head = 0;
+		q.count = 0;
+		q.data.assign((size_t)slots * slotSize, 0);
+		q.lengths.assign(slots, 0);
+		q.senders.assign(slots, sockaddr_in());
+		return true;
+	}
+
+	/**
+	 * Drains up to maxDatagrams already-arrived datagrams into their channel queues, never blocking.
+	 * Returns the number of datagrams read off the socket.
+	 */
+	int  PumpDemux(int maxDatagrams) {
+		if (m_hSocket == INVALID_SOCKET || m_iDemuxWidth == 0) return 0;
+
+		int n = 0;
+		struct sockaddr_in from;
+		while (n < maxDatagrams) {
+			int ret;
+			if (m_recvImpairment.IsActive()) {
+				ret = ReceiveImpaired(&m_vDemuxRecvBuf[0], (int)m_vDemuxRecvBuf.size(), from, false);
+			} else {
+				ret = ReceiveDatagramNow(&m_vDemuxRecvBuf[0], (int)m_vDemuxRecvBuf.size(), from);
+				if (ret >= 0 && m_recorder.IsOpen())
+					m_recorder.Record(&m_vDemuxRecvBuf[0], ret, from, m_saLocal);
+			}
+			if (ret < 0) {
+				if (!hxudpWouldBlock()) ofxNetworkCheckError();
+				break;
+			}
+			RouteDatagram(&m_vDemuxRecvBuf[0], ret, from);
+			n++;
+		}
+		return n;
+	}
+
+	/**
+	 * Receives the next datagram of one channel. When its queue is empty, datagrams are read
+	 * from the socket (blocking if the socket blocks) and routed until one for this channel arrives.
+	 * Return values:
+	 * the datagram size, or SOCKET_ERROR in case of a problem or when non-blocking and nothing is queued.
+	 */
+	int  ReceiveChannel(int channel, char* pBuff, const int iSize) {
+		if (m_hSocket == INVALID_SOCKET || m_iDemuxWidth == 0
+			|| channel < 0 || channel >= (int)m_vDemuxQueues.size()
+			|| m_vDemuxQueues[channel].lengths.empty()) return(SOCKET_ERROR);
+
+		DemuxQueue& q = m_vDemuxQueues[channel];
+		struct sockaddr_in from;
+		while (q.count == 0) {
+			int ret = ReceiveDatagram(&m_vDemuxRecvBuf[0], (int)m_vDemuxRecvBuf.size(), from);
+			if (ret < 0) {
+				if (!hxudpWouldBlock()) ofxNetworkCheckError();
+				canGetRemoteAddress = false;
+				m_iPeerId = -1;
+				return ret;
+			}
+			RouteDatagram(&m_vDemuxRecvBuf[0], ret, from);
+		}
+
+		int len = q.lengths[q.head];
+		int n = len < iSize ? len : iSize;
+		memcpy(pBuff, &q.data[(size_t)q.head * q.slotSize], n);
+		saClient = q.senders[q.head];
+		q.head = (q.head + 1) % (int)q.lengths.size();
+		q.count--;
+
+		canGetRemoteAddress = true;
+		m_iPeerId = TrackPeer(saClient);
+		return n;
+	}
+
+	/**
+	 * Number of datagrams waiting on a channel.
+	 */
+	int  GetDemuxPending(int channel) {
+		if (channel < 0 || channel >= (int)m_vDemuxQueues.size()) return 0;
+
+		return m_vDemuxQueues[channel].count;
+	}
+
+	DemuxStats GetDemuxStats() {
+		return m_demuxStats;
+	}
+
+	/**
+	 * Steers this socket's datagrams to the SO_REUSEPORT group member whose SO_INCOMING_CPU matches
+	 * the CPU handling the packet (Linux only).
+	 */
+	bool SetIncomingCpu(int cpu) {
+		if (m_hSocket == INVALID_SOCKET) return(false);
+
+		#ifdef SO_INCOMING_CPU
+			if (setsockopt(m_hSocket, SOL_SOCKET, SO_INCOMING_CPU, (char*)&cpu, sizeof(cpu)) == 0){
+				return true;
+			}
+		#else
+			hxudpSetError(ENOPROTOOPT);
+		#endif
+		ofxNetworkCheckError();
+		return false;
+	}
+
+	/**
+	 * returns the CPU that processed the last packet received on this socket (SO_INCOMING_CPU),
+	 * i.e. the RSS queue delivering its traffic. -1 if unknown.
+	 * Linux only measures it on connected UDP sockets; on any other socket the option merely echoes
+	 * SetIncomingCpu(), so -1 is returned instead. Connect() does not connect the socket itself.
+	 */
+	int  GetIncomingCpu() {
+		if (m_hSocket == INVALID_SOCKET) return(-1);
+
+		#ifdef SO_INCOMING_CPU
+			struct sockaddr_in peer;
+			socklen_t peerLen = sizeof(peer);
+			if (getpeername(m_hSocket, (sockaddr *)&peer, &peerLen) != 0)
+				return -1;
+
+			int cpu = -1;
 			socklen_t size = sizeof(int);
+			if (getsockopt(m_hSocket, SOL_SOCKET, SO_INCOMING_CPU, (char*)&cpu, &size) == 0)
+				return cpu;
+			ofxNetworkCheckError();
+		#endif
+		return -1;
+	}
+
+	/**
+	 * Pins the calling thread to the CPU that delivers this socket's traffic.
+	 * Returns that CPU, or -1 if it is unknown or pinning failed.
+	 */
+	int  PinToIncomingCpu() {
+		int cpu = GetIncomingCpu();
+		if (cpu < 0 || !hxudpPinThreadToCpu(cpu)) return -1;
+		return cpu;
+	}
+
+	/**
+	 * Starts capturing every datagram this socket receives to a pcap file at path.
+	 * initialBytes sizes the first mapping (0 for PCAP_DEFAULT_CAPACITY); it grows as needed.
+	 * The destination recorded is the bound address, so it is 0.0.0.0 on a socket bound to INADDR_ANY.
+	 */
+	bool StartRecording(const char* path, int initialBytes) {
+		if (m_hSocket == INVALID_SOCKET) return(false);
+
+		#ifndef TARGET_WIN32
+			socklen_t nLen= sizeof(sockaddr);
+		#else
+			int	nLen= sizeof(sockaddr);
+		#endif
+		memset(&m_saLocal, 0, sizeof(m_saLocal));
+		getsockname(m_hSocket, (sockaddr *)&m_saLocal, &nLen);
+
+		if (!m_recorder.Open(path, initialBytes)) {
+			ofxNetworkCheckError();
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * Stops capturing. Returns the number of datagrams recorded.
+	 */
+	int  StopRecording() {
+		return m_recorder.Close();
+	}
+
+	/**
+	 * Sends the UDP payloads of a pcap file (raw IPv4 or Ethernet) to the current destination,
+	 * keeping the recorded gaps between packets divided by rate. A rate of 0 sends as fast as possible.
+	 * Microsecond and nanosecond captures are read; a record longer than the snapshot length or
+	 * 65535 bytes ends the replay. Blocks until done. Returns the number of datagrams sent,
+	 * or -1 if the file is unreadable.
+	 */
+	int  Replay(const char* path, double rate) {
+		if (m_hSocket == INVALID_SOCKET) return(-1);
+
+		FILE* file = fopen(path, "rb");
+		if (file == NULL) return -1;
+
+		unsigned char header[PCAP_HEADER_SIZE];
+		if (fread(header, 1, PCAP_HEADER_SIZE, file) != PCAP_HEADER_SIZE) {
+			fclose(file);
+			return -1;
+		}
+		unsigned int magic;
+		memcpy(&magic, header, 4);
+		bool swapped = magic == PCAP_MAGIC_SWAPPED || magic == PCAP_MAGIC_NANO_SWAPPED;
+		bool nano = magic == PCAP_MAGIC_NANO || magic == PCAP_MAGIC_NANO_SWAPPED;
+		if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NANO && !swapped) {
+			fclose(file);
+			return -1;
+		}
+		unsigned int snapLen = ReadPcapInt(header + 16, swapped);
+		unsigned int linkType = ReadPcapInt(header + 20, swapped);
+
+		vector<unsigned char> packet(65536);
+		unsigned int maxLen = (unsigned int)packet.size() - 1;
+		if (snapLen > 0 && snapLen < maxLen) maxLen = snapLen;
+		long long start = hxudpGetMicros();
+		long long first = -1;
+		int sent = 0;
+
+		unsigned char record[PCAP_RECORD_HEADER_SIZE];
+		while (fread(record, 1, PCAP_RECORD_HEADER_SIZE, file) == PCAP_RECORD_HEADER_SIZE) {
+			unsigned int fraction = ReadPcapInt(record + 4, swapped);
+			long long ts = (long long)ReadPcapInt(record, swapped) * 1000000LL + (nano ? fraction / 1000 : fraction);
+			unsigned int len = ReadPcapInt(record + 8, swapped);
+			if (len > maxLen) break;
+			if (fread(&packet[0], 1, len, file) != len) break;
+
+			const unsigned char* ip = &packet[0];
+			int ipLen = (int)len;
+			if (linkType == PCAP_LINKTYPE_ETHERNET) {
+				if (ipLen < 14 || ip[12] != 0x08 || ip[13] != 0x00) continue;
+				ip += 14;
+				ipLen -= 14;
+			} else if (linkType != PCAP_LINKTYPE_RAW && linkType != PCAP_LINKTYPE_IPV4) {
+				break;
+			}
+			if (ipLen < 20 || (ip[0] >> 4) != 4 || ip[9] != IPPROTO_UDP) continue;
+			int ihl = (ip[0] & 0x0F) * 4;
+			if (ipLen < ihl + 8) continue;
+			const unsigned char* udp = ip + ihl;
+			int payload = ((udp[4] << 8) | udp[5]) - 8;
+			if (payload < 0 || ihl + 8 + payload > ipLen) continue;
+
+			if (first < 0) first = ts;
+			if (rate > 0) {
+				long long due = start + (long long)((ts - first) / rate);
+				hxudpSleepMicros(due - hxudpGetMicros());
+			}
+
+			if (SendTo((const char*)udp + 8, payload, saClient) != SOCKET_ERROR)
+				sent++;
+		}
+
+		fclose(file);
+		return sent;
+	}
+
+	/**
+	 * Emulates a bad network on one direction (IMPAIR_SEND or IMPAIR_RECEIVE) of this socket:
+	 * loss, duplication, reordering, latency with jitter and a bandwidth cap. Every random decision
+	 * comes from config.seed, so a test run can be replayed exactly. An all-zero config turns it off
+	 * once the datagrams it holds are released.
+	 * Datagrams held on the send side go out on the next Send(), SendAll() or other send, or on
+	 * PumpImpairment() and FlushImpairment(). Those held on the receive side are delivered by the
+	 * receive calls: Receive(), ReceiveMessage(), ReceiveCoalesced(), ReceiveChannel() and PumpDemux().
+	 * Close() turns both directions off and counts what they still hold as dropped.
+	 */
+	bool SetImpairment(int direction, const ImpairmentConfig& config) {
+		if (direction != IMPAIR_SEND && direction != IMPAIR_RECEIVE) return(false);
+
+		if (m_vImpairBuf.empty()) m_vImpairBuf.resize(UDP_MAX_PAYLOAD);
+		(direction == IMPAIR_SEND ? m_sendImpairment : m_recvImpairment).Configure(config);
+		return true;
+	}
+
+	/**
+	 * Sends the held datagrams that are due. Returns the number sent.
+	 */
+	int  PumpImpairment() {
+		if (m_hSocket == INVALID_SOCKET || !m_sendImpairment.IsActive()) return 0;
+
+		int sent = 0;
+		long long now = hxudpGetMicros();
+		struct sockaddr_in to;
+		int len;
+		while ((len = m_sendImpairment.Pop(now, &m_vImpairBuf[0], (int)m_vImpairBuf.size(), to)) >= 0) {
+			if (WriteDatagram(&m_vImpairBuf[0], len, to, 0) != SOCKET_ERROR)
+				sent++;
+		}
+		return sent;
+	}
+
+	/**
+	 * Microseconds until the next held datagram of either direction is due, or -1 if none is held.
+	 */
+	int  GetImpairmentDelay() {
+		long long now = hxudpGetMicros();
+		int send = m_sendImpairment.GetDelay(now);
+		int recv = m_recvImpairment.GetDelay(now);
+		if (send < 0) return recv;
+		if (recv < 0) return send;
+		return send < recv ? send : recv;
+	}
+
+	/**
+	 * Blocks until every datagram held on the send side is sent.
+	 * Returns the number of datagrams sent.
+	 */
+	int  FlushImpairment() {
+		if (m_hSocket == INVALID_SOCKET) return 0;
+
+		int sent = 0;
+		int delay;
+		while ((delay = m_sendImpairment.GetDelay(hxudpGetMicros())) >= 0) {
+			hxudpSleepMicros(delay);
+			sent += PumpImpairment();
+		}
+		return sent;
+	}
+
+	ImpairmentStats GetImpairmentStats(int direction) {
+		return (direction == IMPAIR_SEND ? m_sendImpairment : m_recvImpairment).GetStats();
+	}
+
+protected:
+	/**
+	 * Common send path for everything that goes out of this socket: applies pacing, then SendDatagram().
+	 */
+	int  SendTo(const char* pBuff, const int iSize, const sockaddr_in& to) {
+		if (m_iPacingBytesPerSec > 0 || m_iPacingPacketsPerSec > 0)
+			return SendPaced(pBuff, iSize, to);
+
+		return SendDatagram(pBuff, iSize, to, 0);
+	}
+
+	static unsigned int ReadPcapInt(const unsigned char* p, bool swapped) {
+		unsigned int v;
+		memcpy(&v, p, 4);
+		if (swapped)
+			v = (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+		return v;
+	}
+
+	/**
+	 * Looks up the datagram's channel and copies it into that channel's queue, or drops it.
+	 */
+	void RouteDatagram(const char* pBuff, const int iLen, const sockaddr_in& from) {
+		if (iLen < m_iDemuxOffset + m_iDemuxWidth) {
+			m_demuxStats.unrouted++;
+			return;
+		}
+
+		const unsigned char* p = (const unsigned char*)pBuff + m_iDemuxOffset;
+		unsigned int raw = 0;
+		for (int i = 0; i < m_iDemuxWidth; i++)
+			raw = (raw << 8) | p[i];
+		int channel = m_vDemuxRoutes[(raw & m_uDemuxMask) >> m_iDemuxShift];
+
+		if (channel < 0 || channel >= (int)m_vDemuxQueues.size() || m_vDemuxQueues[channel].lengths.empty()) {
+			m_demuxStats.unrouted++;
+			return;
+		}
+
+		DemuxQueue& q = m_vDemuxQueues[channel];
+		int slots = (int)q.lengths.size();
+		if (q.count == slots) {
+			m_demuxStats.overflow++;
+			return;
+		}
+
+		int slot = (q.head + q.count) % slots;
+		int n = iLen;
+		if (n > q.slotSize) {
+			n = q.slotSize;
+			m_demuxStats.truncated++;
+		}
+		if (n > 0) memcpy(&q.data[(size_t)slot * q.slotSize], pBuff, n);
+		q.lengths[slot] = n;
+		q.senders[slot] = from;
+		q.count++;
+		m_demuxStats.routed++;
+	}
+
+	static unsigned long long PeerKey(const sockaddr_in& addr) {
+		return ((unsigned long long)ntohl(addr.sin_addr.s_addr) << 16) | ntohs(addr.sin_port);
+	}
+
+	static unsigned int PeerHash(unsigned long long key) {
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		return (unsigned int)key;
+	}
+
+	void SchedulePeer(int id) {
+		Peer& peer = m_vPeers[id];
+		long long tick = (peer.lastSeen + m_iPeerIdleMs) / m_iPeerTickMs;
+		if (tick <= m_llPeerTick) tick = m_llPeerTick + 1;
+		int slot = (int)(tick % PEER_WHEEL_SLOTS);
+		peer.wheelNext = m_vPeerWheel[slot];
+		m_vPeerWheel[slot] = id;
+	}
+
+	/**
+	 * Looks the sender up in the open-addressing table (linear probing), adding it if new.
+	 * Returns its peer id, or -1 when the table is off or full.
+	 */
+	int  TrackPeer(const sockaddr_in& from) {
+		if (m_vPeerHash.empty()) return -1;
+
+		long long now = hxudpGetMicros() / 1000;
+		unsigned long long key = PeerKey(from);
+		unsigned int mask = (unsigned int)m_vPeerHash.size() - 1;
+		unsigned int h = PeerHash(key) & mask;
+
+		for (;;) {
+			int id = m_vPeerHash[h];
+			if (id < 0) break;
+			if (m_vPeers[id].key == key) {
+				m_vPeers[id].lastSeen = now;
+				return id;
+			}
+			h = (h + 1) & mask;
+		}
+
+		ExpirePeers();
+		if (m_vPeerFree.empty()) {
+			m_peerStats.rejected++;
+			return -1;
+		}
+		// expiring may have shifted entries, find the free bucket again
+		h = PeerHash(key) & mask;
+		while (m_vPeerHash[h] >= 0) h = (h + 1) & mask;
+
+		int id = m_vPeerFree.back();
+		m_vPeerFree.pop_back();
+		Peer& peer = m_vPeers[id];
+		peer.active = true;
+		peer.key = key;
+		peer.addr = from;
+		peer.lastSeen = now;
+		m_vPeerHash[h] = id;
+		if (m_iPeerIdleMs > 0) SchedulePeer(id);
+
+		m_vNewPeers.push_back(id);
+		m_peerStats.active++;
+		m_peerStats.created++;
+		return id;
+	}
+
+	/**
+	 * Removes a peer from the hash table with backward-shift deletion, so probing never needs tombstones.
+	 */
+	void UnhashPeer(int id) {
+		unsigned int mask = (unsigned int)m_vPeerHash.size() - 1;
+		unsigned int h = PeerHash(m_vPeers[id].key) & mask;
+		while (m_vPeerHash[h] != id) h = (h + 1) & mask;
+
+		unsigned int hole = h;
+		for (;;) {
+			h = (h + 1) & mask;
+			int other = m_vPeerHash[h];
+			if (other < 0) break;
+			unsigned int home = PeerHash(m_vPeers[other].key) & mask;
+			// move `other` into the hole unless its home lies cyclically in (hole, h]
+			if (((h - home) & mask) >= ((h - hole) & mask)) {
+				m_vPeerHash[hole] = other;
+				hole = h;
+			}
+		}
+		m_vPeerHash[hole] = -1;
+	}
+
+	/**
+	 * Advances the timer wheel to now. Peers seen since they were scheduled are rescheduled,
+	 * the others are dropped and queued for PollPeerEvents().
+	 */
+	void ExpirePeers() {
+		if (m_iPeerIdleMs == 0 || m_vPeers.empty()) return;
+
+		long long now = hxudpGetMicros() / 1000;
+		long long target = now / m_iPeerTickMs;
+		if (target - m_llPeerTick > PEER_WHEEL_SLOTS) m_llPeerTick = target - PEER_WHEEL_SLOTS;
+
+		while (m_llPeerTick < target) {
+			m_llPeerTick++;
+			int slot = (int)(m_llPeerTick % PEER_WHEEL_SLOTS);
+			int id = m_vPeerWheel[slot];
+			m_vPeerWheel[slot] = -1;
+
+			while (id >= 0) {
+				Peer& peer = m_vPeers[id];
+				int next = peer.wheelNext;
+				if (peer.lastSeen + m_iPeerIdleMs <= now) {
+					UnhashPeer(id);
+					peer.active = false;
+					m_vExpiredPeers.push_back(id);
+					m_peerStats.active--;
+					m_peerStats.expired++;
+				} else {
+					SchedulePeer(id);
+				}
+				id = next;
+			}
+		}
+	}
+
+	/**
+	 * Index of the pending buffer for a destination in m_vCoalesce, allocating one if there is none.
+	 * Only buffers holding messages are kept; FlushCoalesceBuffer() hands them back.
+	 */
+	int  GetCoalesceBuffer(const sockaddr_in& to) {
+		unsigned long long key = PeerKey(to);
+		map<unsigned long long, int>::iterator it = m_mCoalesceIndex.find(key);
+		if (it != m_mCoalesceIndex.end()) return it->second;
+
+		int index = (int)m_vCoalesce.size();
+		m_vCoalesce.push_back(CoalesceBuffer());
+		CoalesceBuffer& buf = m_vCoalesce.back();
+		if (!m_vCoalesceSpare.empty()) {
+			buf.data.swap(m_vCoalesceSpare.back());
+			m_vCoalesceSpare.pop_back();
+		}
+		buf.addr = to;
+		if (m_iCoalesceSize > 0) {
+			buf.data.resize(m_iCoalesceSize);
+		} else {
+			// probing the path MTU costs a socket and three calls; do it once per destination
+			if (m_iCoalescePathSize == 0 || m_ullCoalescePathKey != key) {
+				m_iCoalescePathSize = GetUnfragmentedSize();
+				m_ullCoalescePathKey = key;
+			}
+			buf.data.resize(m_iCoalescePathSize);
+		}
+		buf.used = COALESCE_HEADER_SIZE;
+		buf.count = 0;
+		buf.deadline = 0;
+		m_mCoalesceIndex[key] = index;
+		return index;
+	}
+
+	/**
+	 * Sends a buffer if it holds anything, then releases it. This moves the last buffer to index.
+	 */
+	int  FlushCoalesceBuffer(int index) {
+		CoalesceBuffer& buf = m_vCoalesce[index];
+		int ret = 0;
+		if (buf.count > 0) {
+			unsigned char* p = (unsigned char*)&buf.data[0];
+			p[0] = COALESCE_MAGIC >> 8;
+			p[1] = COALESCE_MAGIC & 0xFF;
+			ret = SendTo(&buf.data[0], buf.used, buf.addr);
+			m_coalesceStats.datagrams++;
+		}
+		ReleaseCoalesceBuffer(index);
+		return ret;
+	}
+
+	void ReleaseCoalesceBuffer(int index) {
+		m_mCoalesceIndex.erase(PeerKey(m_vCoalesce[index].addr));
+		if ((int)m_vCoalesceSpare.size() < COALESCE_SPARE_BUFFERS) {
+			m_vCoalesceSpare.push_back(vector<char>());
+			m_vCoalesceSpare.back().swap(m_vCoalesce[index].data);
+		}
+
+		int last = (int)m_vCoalesce.size() - 1;
+		if (index != last) {
+			CoalesceBuffer& dst = m_vCoalesce[index];
+			CoalesceBuffer& src = m_vCoalesce[last];
+			dst.addr = src.addr;
+			dst.data.swap(src.data);
+			dst.used = src.used;
+			dst.count = src.count;
+			dst.deadline = src.deadline;
+			m_mCoalesceIndex[PeerKey(dst.addr)] = index;
+		}
+		m_vCoalesce.pop_back();
+	}
+
+	/**
+	 * Flushes every destination without counting it as an explicit flush.
+	 */
+	int  FlushAllCoalesced() {
+		int sent = 0;
+		while (!m_vCoalesce.empty()) {
+			if (FlushCoalesceBuffer((int)m_vCoalesce.size() - 1) != SOCKET_ERROR) sent++;
+		}
+		return sent;
+	}
+
+	/**
+	 * Writes a length-prefixed message at pos; a datagram built from scratch also gets the magic.
+	 */
+	static void WriteCoalesceMessage(char* out, int pos, const char* pBuff, const int iSize) {
+		unsigned char* p = (unsigned char*)out;
+		if (pos == COALESCE_HEADER_SIZE) {
+			p[0] = COALESCE_MAGIC >> 8;
+			p[1] = COALESCE_MAGIC & 0xFF;
+		}
+		p[pos] = (iSize >> 8) & 0xFF;
+		p[pos + 1] = iSize & 0xFF;
+		if (iSize > 0) memcpy(out + pos + COALESCE_LENGTH_SIZE, pBuff, iSize);
+	}
+
+	/**
+	 * Largest datagram payload that crosses the path to the current destination without
+	 * IP fragmentation, assuming DEFAULT_PATH_MTU when the OS cannot tell.
+	 */
+	int  GetUnfragmentedSize() {
+		int mtu = GetPathMtu();
+		int size = (mtu > UDP_IP_HEADER_SIZE ? mtu : DEFAULT_PATH_MTU) - UDP_IP_HEADER_SIZE;
+		return size < UDP_MAX_PAYLOAD ? size : UDP_MAX_PAYLOAD;
+	}
+
+	/**
+	 * Hands a datagram to the send-side impairment layer when it is active, else to WriteDatagram().
+	 * Impaired datagrams ignore txTime: the layer picks their departure time.
+	 */
+	int  SendDatagram(const char* pBuff, const int iSize, const sockaddr_in& to, long long txTime) {
+		if (!m_sendImpairment.IsActive())
+			return WriteDatagram(pBuff, iSize, to, txTime);
+
+		PumpImpairment();
+		int copies = m_sendImpairment.Admit(pBuff, iSize, to, hxudpGetMicros(), 2);
+		for (int i = 0; i < copies; i++) {
+			if (WriteDatagram(pBuff, iSize, to, 0) == SOCKET_ERROR)
+				return(SOCKET_ERROR);
+		}
+		return iSize;
+	}
+
+	/**
+	 * Puts a single datagram on the wire.
+	 * txTime is a CLOCK_MONOTONIC departure time in microseconds passed along as SCM_TXTIME, 0 for none.
+	 */
+	int  WriteDatagram(const char* pBuff, const int iSize, const sockaddr_in& to, long long txTime) {
+		#if defined(SO_TXTIME) && defined(SCM_TXTIME)
+		if (txTime > 0) {
+			struct iovec iov;
+			iov.iov_base = (void*)pBuff;
+			iov.iov_len = iSize;
+
+			char control[CMSG_SPACE(sizeof(unsigned long long))];
+			memset(control, 0, sizeof(control));
+
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_name = (void*)&to;
+			msg.msg_namelen = sizeof(sockaddr_in);
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+
+			struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+			cm->cmsg_level = SOL_SOCKET;
+			cm->cmsg_type = SCM_TXTIME;
+			cm->cmsg_len = CMSG_LEN(sizeof(unsigned long long));
+			unsigned long long ns = (unsigned long long)txTime * 1000ULL;
+			memcpy(CMSG_DATA(cm), &ns, sizeof(ns));
+
+			int ret = sendmsg(m_hSocket, &msg, 0);
+			if(ret==-1) ofxNetworkCheckError();
+			return ret;
+		}
+		#endif
+
+		int ret = sendto(m_hSocket, (char*)pBuff, iSize, 0, (sockaddr *)&to, sizeof(sockaddr));
+		if(ret==-1) ofxNetworkCheckError();
+		return ret;
+	}
+
+	/**
+	 * recvfrom() wrapper used by every receive path.
+	 * Goes through the receive-side impairment layer when it is active,
+	 * else spins first when busy polling is enabled in user space.
+	 */
+	int  ReceiveDatagram(char* pBuff, const int iSize, sockaddr_in& from) {
+		if (m_recvImpairment.IsActive())
+			return ReceiveImpaired(pBuff, iSize, from, !nonBlocking);
+
+		#ifndef TARGET_WIN32
+			socklen_t nLen= sizeof(sockaddr);
+		#else
+			int	nLen= sizeof(sockaddr);
+		#endif
+
+		int ret;
+		if (m_busyPollStats.kernel)
+			ret = ReceiveKernelPoll(pBuff, iSize, from);
+		else if (m_iSpinMicros > 0)
+			ret = ReceiveSpin(pBuff, iSize, from);
+		else
+			ret = recvfrom(m_hSocket, pBuff, iSize, 0, (sockaddr *)&from, &nLen);
+
+		if (ret >= 0 && m_recorder.IsOpen())
+			m_recorder.Record(pBuff, ret, from, m_saLocal);
+		return ret;
+	}
+
+	/**
+	 * Moves whatever has arrived on the socket into the receive-side impairment layer, then returns
+	 * the first datagram due. When nothing is due and block is set, waits for the next release time
+	 * or for new traffic, whichever comes first; with nothing held, the receive timeout applies.
+	 * Datagrams are recorded as they come off the wire, before being impaired.
+	 */
+	int  ReceiveImpaired(char* pBuff, const int iSize, sockaddr_in& from, bool block) {
+		#ifndef TARGET_WIN32
+			socklen_t nLen= sizeof(sockaddr);
+		#else
+			int	nLen= sizeof(sockaddr);
+		#endif
+
+		char* buf = &m_vImpairBuf[0];
+		for (;;) {
+			long long now = hxudpGetMicros();
+			int ret = m_recvImpairment.Pop(now, pBuff, iSize, from);
+			if (ret >= 0) return ret;
+
+			int delay = m_recvImpairment.GetDelay(now);
+			struct sockaddr_in src;
+			if (block && delay < 0) {
+				nLen = sizeof(sockaddr);
+				ret = recvfrom(m_hSocket, buf, (int)m_vImpairBuf.size(), 0, (sockaddr *)&src, &nLen);
+			} else {
+				if (block) {
+					fd_set fd;
+					FD_ZERO(&fd);
+					FD_SET(m_hSocket, &fd);
+					timeval	tv;
+					tv.tv_sec = delay / 1000000;
+					tv.tv_usec = delay % 1000000;
+					select(m_hSocket+1, &fd, NULL, NULL, &tv);
+				}
+				ret = ReceiveDatagramNow(buf, (int)m_vImpairBuf.size(), src);
+			}
+
+			if (ret < 0) {
+				if (block && delay >= 0 && hxudpWouldBlock()) continue;
+				return ret;
+			}
+
+			if (m_recorder.IsOpen())
+				m_recorder.Record(buf, ret, src, m_saLocal);
+			if (m_recvImpairment.Admit(buf, ret, src, hxudpGetMicros(), 1) > 0) {
+				int n = ret < iSize ? ret : iSize;
+				memcpy(pBuff, buf, n);
+				from = src;
+				return n;
+			}
+		}
+	}
+
+	/**
+	 * recvfrom() that never blocks, whatever mode the socket is in.
+	 */
+	int  ReceiveDatagramNow(char* pBuff, const int iSize, sockaddr_in& from) {
+		#ifndef TARGET_WIN32
+			socklen_t nLen= sizeof(sockaddr);
+		#else
+			int	nLen= sizeof(sockaddr);
+		#endif
+
+		#ifdef MSG_DONTWAIT
+			return recvfrom(m_hSocket, pBuff, iSize, MSG_DONTWAIT, (sockaddr *)&from, &nLen);
+		#else
+			fd_set fd;
+			FD_ZERO(&fd);
+			FD_SET(m_hSocket, &fd);
+			timeval	tv = {0, 0};
+			if (select(m_hSocket+1, &fd, NULL, NULL, &tv) > 0)
+				return recvfrom(m_hSocket, pBuff, iSize, 0, (sockaddr *)&from, &nLen);
+			hxudpSetError(EAGAIN);
+			return SOCKET_ERROR;
+		#endif
+	}
+
+	/**
+	 * recvfrom() with SO_BUSY_POLL set. The kernel spins for up to m_iSpinMicros before sleeping,
+	 * so a datagram returned within that window counts as a spin hit and a later one as a sleep hit.
+	 */
+	int  ReceiveKernelPoll(char* pBuff, const int iSize, sockaddr_in& from) {
+		#ifndef TARGET_WIN32
+			socklen_t nLen= sizeof(sockaddr);
 		#else
-			int size = sizeof(int);
+			int	nLen= sizeof(sockaddr);
 		#endif
 
-		int ret = getsockopt(m_hSocket, SOL_SOCKET, SO_MAX_MSG_SIZE, (char*)&sizeBuffer, &size);
-		if(ret==-1) ofxNetworkCheckError();
-		return sizeBuffer;
+		long long start = hxudpGetMicros();
+		int ret = recvfrom(m_hSocket, pBuff, iSize, 0, (sockaddr *)&from, &nLen);
+		if (ret < 0) return ret;
+
+		// the kernel may have spun or slept, or the datagram was already queued; only the wait is known
+		m_busyPollStats.sleepMicros += (double)(hxudpGetMicros() - start);
+		m_busyPollStats.sleepHits++;
+		return ret;
 	}
 
 	/**
-	 * returns -1 on failure
+	 * Polls with a non-blocking recvfrom, backing off exponentially between attempts, until the
+	 * spin budget runs out. The budget halves after every miss (down to 1/16 of the configured
+	 * value) and doubles after every hit, so idle sockets stop burning CPU on their own.
 	 */
-	int  GetTTL() {
-		if (m_hSocket == INVALID_SOCKET) return(false);
-
-		int nTTL;
-
+	int  ReceiveSpin(char* pBuff, const int iSize, sockaddr_in& from) {
 		#ifndef TARGET_WIN32
-			socklen_t nSize = sizeof(int);
+			socklen_t nLen= sizeof(sockaddr);
 		#else
-			int nSize = sizeof(int);
+			int	nLen= sizeof(sockaddr);
 		#endif
 
-		if (getsockopt(m_hSocket, IPPROTO_IP, IP_MULTICAST_TTL, (char FAR *) &nTTL, &nSize) == SOCKET_ERROR)
-		{
-			#ifdef _DEBUG
-			printf("getsockopt failed! Error: %d", WSAGetLastError());
-			#endif
-			ofxNetworkCheckError();
+		int budget = m_busyPollStats.budget;
+		long long start = hxudpGetMicros();
+		long long now = start;
+		int pause = 1;
+		int ret;
+
+		for (;;) {
+			ret = ReceiveDatagramNow(pBuff, iSize, from);
+
+			now = hxudpGetMicros();
+			if (ret >= 0) {
+				m_busyPollStats.spinMicros += (double)(now - start);
+				m_busyPollStats.spinHits++;
+				budget *= 2;
+				m_busyPollStats.budget = budget < m_iSpinMicros ? budget : m_iSpinMicros;
+				return ret;
+			}
+			if (!hxudpWouldBlock())
+				return ret;
+			if (now - start >= budget)
+				break;
+
+			for (int i = 0; i < pause; i++) HXUDP_CPU_RELAX();
+			if (pause < 1024) pause *= 2;
+		}
+
+		m_busyPollStats.spinMicros += (double)(now - start);
+		budget /= 2;
+		m_busyPollStats.budget = budget > m_iSpinMicros / 16 ? budget : (m_iSpinMicros / 16 > 0 ? m_iSpinMicros / 16 : 1);
+
+		if (nonBlocking)
+			return ret;
+
+		nLen = sizeof(sockaddr);
+		ret = recvfrom(m_hSocket, pBuff, iSize, 0, (sockaddr *)&from, &nLen);
+		m_busyPollStats.sleepMicros += (double)(hxudpGetMicros() - now);
+		if (ret >= 0) m_busyPollStats.sleepHits++;
+		return ret;
+	}
+
+	static void WriteFragmentHeader(char* out, int index, int count, int payload, unsigned long msgId, int totalLength) {
+		unsigned char* p = (unsigned char*)out;
+		p[0] = FRAG_MAGIC >> 8;		p[1] = FRAG_MAGIC & 0xFF;
+		p[2] = index >> 8;			p[3] = index & 0xFF;
+		p[4] = count >> 8;			p[5] = count & 0xFF;
+		p[6] = payload >> 8;		p[7] = payload & 0xFF;
+		p[8] = (msgId >> 24) & 0xFF;	p[9] = (msgId >> 16) & 0xFF;
+		p[10] = (msgId >> 8) & 0xFF;	p[11] = msgId & 0xFF;
+		p[12] = (totalLength >> 24) & 0xFF;	p[13] = (totalLength >> 16) & 0xFF;
+		p[14] = (totalLength >> 8) & 0xFF;	p[15] = totalLength & 0xFF;
+	}
+
+	/**
+	 * Feeds one received datagram to the reassembly table.
+	 * Returns the message length once it is complete and copied to pOut, -1 otherwise.
+	 */
+	int  ReassembleFragment(const char* pDatagram, const int iLen, const sockaddr_in& from, char* pOut, const int iOutSize) {
+		const unsigned char* p = (const unsigned char*)pDatagram;
+		if (iLen < FRAG_HEADER_SIZE || ((p[0] << 8) | p[1]) != FRAG_MAGIC) {
+			m_fragmentStats.invalid++;
 			return -1;
 		}
 
-		return nTTL;
+		int index = (p[2] << 8) | p[3];
+		int count = (p[4] << 8) | p[5];
+		int payload = (p[6] << 8) | p[7];
+		unsigned long msgId = ((unsigned long)p[8] << 24) | (p[9] << 16) | (p[10] << 8) | p[11];
+		long totalLength = ((long)p[12] << 24) | (p[13] << 16) | (p[14] << 8) | p[15];
+
+		int expectedCount = totalLength > 0 && payload > 0 ? (int)((totalLength + payload - 1) / payload) : 1;
+		long offset = (long)index * payload;
+		long fragLen = totalLength - offset < payload ? totalLength - offset : payload;
+		if (count == 0 || index >= count || count != expectedCount || fragLen < 0
+			|| iLen - FRAG_HEADER_SIZE != fragLen) {
+			m_fragmentStats.invalid++;
+			return -1;
+		}
+
+		const char* data = pDatagram + FRAG_HEADER_SIZE;
+
+		if (count == 1) {
+			int n = (int)fragLen < iOutSize ? (int)fragLen : iOutSize;
+			memcpy(pOut, data, n);
+			m_fragmentStats.completed++;
+			return n;
+		}
+
+		if (totalLength > m_iReassemblyMaxSize || payload < FRAG_MIN_PAYLOAD) {
+			m_fragmentStats.invalid++;
+			return -1;
+		}
+
+		long long now = hxudpGetMicros();
+		ReassemblySlot* slot = NULL;
+		ReassemblySlot* victim = NULL;
+		for (size_t i = 0; i < m_vReassembly.size(); i++) {
+			ReassemblySlot& s = m_vReassembly[i];
+			if (s.used && m_iReassemblyTimeout > 0 && now - s.lastUpdate > (long long)m_iReassemblyTimeout * 1000LL) {
+				s.used = false;
+				m_fragmentStats.expired++;
+			}
+			if (s.used && s.msgId == msgId && s.addr == from.sin_addr.s_addr && s.port == from.sin_port) {
+				slot = &s;
+			} else if (!slot && (!victim || (victim->used && (!s.used || s.lastUpdate < victim->lastUpdate)))) {
+				victim = &s;
+			}
+		}
+
+		if (!slot) {
+			slot = victim;
+			if (slot->used) m_fragmentStats.evicted++;
+			slot->used = true;
+			slot->addr = from.sin_addr.s_addr;
+			slot->port = from.sin_port;
+			slot->msgId = msgId;
+			slot->count = count;
+			slot->received = 0;
+			slot->totalLength = (int)totalLength;
+			memset(&slot->bitmap[0], 0, (count + 7) / 8);
+		} else if (slot->count != count || slot->totalLength != totalLength) {
+			m_fragmentStats.invalid++;
+			return -1;
+		}
+		slot->lastUpdate = now;
+
+		unsigned char bit = (unsigned char)(1 << (index & 7));
+		if (slot->bitmap[index >> 3] & bit) {
+			m_fragmentStats.duplicates++;
+			return -1;
+		}
+		slot->bitmap[index >> 3] |= bit;
+		memcpy(&slot->data[offset], data, fragLen);
+
+		if (++slot->received < slot->count)
+			return -1;
+
+		slot->used = false;
+		m_fragmentStats.completed++;
+		int n = slot->totalLength < iOutSize ? slot->totalLength : iOutSize;
+		memcpy(pOut, &slot->data[0], n);
+		return n;
 	}
 
-	bool SetTTL(int nTTL) {
-		if (m_hSocket == INVALID_SOCKET) return(false);
+	/**
+	 * Earliest-departure-time token bucket: each datagram is scheduled one "cost" after the previous one,
+	 * where the cost is whichever of the byte and packet limits is stricter.
+	 */
+	int  SendPaced(const char* pBuff, const int iSize, const sockaddr_in& to) {
+		PumpPacing();
+
+		long long cost = 0;
+		if (m_iPacingBytesPerSec > 0)
+			cost = (long long)iSize * 1000000LL / m_iPacingBytesPerSec;
+		if (m_iPacingPacketsPerSec > 0 && 1000000LL / m_iPacingPacketsPerSec > cost)
+			cost = 1000000LL / m_iPacingPacketsPerSec;
+
+		long long now = hxudpGetMicros();
+		long long due = m_llPaceNext > now ? m_llPaceNext : now;
+
+		if (m_bTxTime) {
+			m_llPaceNext = due + cost;
+			if (due > now) m_pacingStats.delayed++;
+			int ret = SendDatagram(pBuff, iSize, to, due);
+			if (ret != SOCKET_ERROR) m_pacingStats.sent++;
+			return ret;
+		}
 
-		// Set the Time-to-Live of the multicast.
-		if (setsockopt(m_hSocket, IPPROTO_IP, IP_MULTICAST_TTL, (char FAR *)&nTTL, sizeof (int)) == SOCKET_ERROR)
-		{
-			#ifdef _DEBUG
-			printf("setsockopt failed! Error: %d", WSAGetLastError());
-			#endif
+		if (due <= now && m_qPaced.empty()) {
+			m_llPaceNext = due + cost;
+			int ret = SendDatagram(pBuff, iSize, to, 0);
+			if (ret != SOCKET_ERROR) m_pacingStats.sent++;
+			return ret;
+		}
+
+		if (m_pacingStats.queuedBytes + iSize > PACING_QUEUE_LIMIT) {
+			m_pacingStats.dropped++;
+			hxudpSetError(ENOBUFS);
 			ofxNetworkCheckError();
-			return false;
+			return SOCKET_ERROR;
 		}
 
-		return true;
+		m_llPaceNext = due + cost;
+		m_qPaced.push_back(PacedDatagram());
+		PacedDatagram& d = m_qPaced.back();
+		d.data.assign(pBuff, pBuff + iSize);
+		d.addr = to;
+		d.due = due;
+		m_pacingStats.delayed++;
+		m_pacingStats.queued++;
+		m_pacingStats.queuedBytes += iSize;
+		return iSize;
 	}
 
-protected:
 	int m_iListenPort;
 
 	#ifdef TARGET_WIN32
@@ -694,6 +3329,70 @@ protected:
 	static bool m_bWinsockInit;
 	bool canGetRemoteAddress;
 
+	int m_iPacingBytesPerSec;
+	int m_iPacingPacketsPerSec;
+	bool m_bTxTime;
+	long long m_llPaceNext;
+	deque<PacedDatagram> m_qPaced;
+	PacingStats m_pacingStats;
+
+	int m_iSpinMicros;
+	BusyPollStats m_busyPollStats;
+
+	int m_iFragmentSize;
+	int m_iFragPayload;
+	unsigned long m_ulNextMsgId;
+	vector<char> m_vFragSendBuf;
+	vector<char> m_vFragRecvBuf;
+	vector<ReassemblySlot> m_vReassembly;
+	int m_iReassemblyMaxSize;
+	int m_iReassemblyTimeout;
+	FragmentStats m_fragmentStats;
+
+	int m_iCoalesceSize;
+	int m_iCoalesceDeadline;
+	int m_iCoalescePathSize;
+	unsigned long long m_ullCoalescePathKey;
+	bool m_bCoalescing;
+	vector<CoalesceBuffer> m_vCoalesce;
+	map<unsigned long long, int> m_mCoalesceIndex;
+	vector< vector<char> > m_vCoalesceSpare;
+	CoalesceStats m_coalesceStats;
+
+	int m_iPeerId;
+	int m_iPeerIdleMs;
+	int m_iPeerTickMs;
+	long long m_llPeerTick;
+	vector<Peer> m_vPeers;
+	vector<int> m_vPeerHash;
+	vector<int> m_vPeerWheel;
+	vector<int> m_vPeerFree;
+	vector<int> m_vNewPeers;
+	vector<int> m_vExpiredPeers;
+	PeerStats m_peerStats;
+
+	bool m_bZeroCopy;
+	int m_iZeroCopyThreshold;
+	unsigned int m_uZeroCopyNext;
+	deque<ZeroCopyPending> m_qZeroCopy;
+	ZeroCopyStats m_zeroCopyStats;
+
+	int m_iDemuxOffset;
+	int m_iDemuxWidth;
+	unsigned int m_uDemuxMask;
+	int m_iDemuxShift;
+	vector<int> m_vDemuxRoutes;
+	vector<DemuxQueue> m_vDemuxQueues;
+	vector<char> m_vDemuxRecvBuf;
+	DemuxStats m_demuxStats;
+
+	PcapRecorder m_recorder;
+	struct sockaddr_in m_saLocal;
+
+	NetworkImpairment m_sendImpairment;
+	NetworkImpairment m_recvImpairment;
+	vector<char> m_vImpairBuf;
+
 };
 
 
@@ -729,8 +3428,33 @@ return(getsockname(m_hSocket, (sockaddr *)pInetAddr, &iSize) !=	SOCKET_ERROR);
 
 DEFINE_KIND(_UdpSocket);
 
+/**
+ * Buffers sent with MSG_ZEROCOPY are kept alive by a GC root until the kernel releases them.
+ * Before the socket goes away, completions are awaited for up to ZEROCOPY_DRAIN_TIMEOUT ms
+ * outside of the GC when wait is set. A finalizer runs while the GC is collecting and must not
+ * stall it, so it only collects the completions already queued.
+ */
+void release_ZeroCopyRoots(UdpSocket* s, bool wait) {
+	vector<int> ids;
+	vector<void*> tokens;
+	if (wait) {
+		gc_enter_blocking();
+		s->DrainZeroCopy(ZEROCOPY_DRAIN_TIMEOUT, ids, tokens);
+		gc_exit_blocking();
+	} else {
+		s->PollZeroCopy(ids, tokens);
+	}
+	for (size_t i = 0; i < tokens.size(); i++)
+		free_root((value*)tokens[i]);
+
+	// the kernel may still read these pages: keep them rooted for good rather than let the GC reuse them
+	tokens.clear();
+	s->TakeZeroCopyTokens(tokens);
+}
+
 void delete_UdpSocket(value a) {
 	UdpSocket* s = (UdpSocket*) val_data(a);
+	release_ZeroCopyRoots(s, false);
 	delete s;
 }
 
@@ -743,6 +3467,7 @@ DEFINE_PRIM(_UdpSocket_new, 0);
 
 value _UdpSocket_Close(value a) {
 	UdpSocket* s = (UdpSocket*) val_data(a);
+	release_ZeroCopyRoots(s, true);
 	return alloc_bool(s->Close());
 }
 DEFINE_PRIM(_UdpSocket_Close, 1);
@@ -891,4 +3616,454 @@ value _UdpSocket_SetTTL(value a, value b) {
 }
 DEFINE_PRIM(_UdpSocket_SetTTL, 2);
 
+value _UdpSocket_SetMaxPacingRate(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_bool(s->SetMaxPacingRate(val_int(b)));
+}
+DEFINE_PRIM(_UdpSocket_SetMaxPacingRate, 2);
+
+value _UdpSocket_SetPacing(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	s->SetPacing(val_int(b), val_int(c));
+	return alloc_null();
+}
+DEFINE_PRIM(_UdpSocket_SetPacing, 3);
+
+value _UdpSocket_SetTxTime(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_bool(s->SetTxTime(val_bool(b)));
+}
+DEFINE_PRIM(_UdpSocket_SetTxTime, 2);
+
+value _UdpSocket_PumpPacing(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->PumpPacing());
+}
+DEFINE_PRIM(_UdpSocket_PumpPacing, 1);
+
+value _UdpSocket_GetPacingDelay(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->GetPacingDelay());
+}
+DEFINE_PRIM(_UdpSocket_GetPacingDelay, 1);
+
+value _UdpSocket_FlushPacing(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->FlushPacing());
+}
+DEFINE_PRIM(_UdpSocket_FlushPacing, 1);
+
+value _UdpSocket_GetPacingStats(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	PacingStats stats = s->GetPacingStats();
+	value o = alloc_empty_object();
+	alloc_field(o, val_id("sent"), alloc_int(stats.sent));
+	alloc_field(o, val_id("delayed"), alloc_int(stats.delayed));
+	alloc_field(o, val_id("dropped"), alloc_int(stats.dropped));
+	alloc_field(o, val_id("queued"), alloc_int(stats.queued));
+	alloc_field(o, val_id("queuedBytes"), alloc_int(stats.queuedBytes));
+	return o;
+}
+DEFINE_PRIM(_UdpSocket_GetPacingStats, 1);
+
+value _UdpSocket_SetBusyPoll(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_bool(s->SetBusyPoll(val_int(b), val_bool(c)));
+}
+DEFINE_PRIM(_UdpSocket_SetBusyPoll, 3);
+
+value _UdpSocket_GetBusyPollStats(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	BusyPollStats stats = s->GetBusyPollStats();
+	value o = alloc_empty_object();
+	alloc_field(o, val_id("spinMicros"), alloc_float(stats.spinMicros));
+	alloc_field(o, val_id("sleepMicros"), alloc_float(stats.sleepMicros));
+	alloc_field(o, val_id("spinHits"), alloc_int(stats.spinHits));
+	alloc_field(o, val_id("sleepHits"), alloc_int(stats.sleepHits));
+	alloc_field(o, val_id("budget"), alloc_int(stats.budget));
+	alloc_field(o, val_id("kernel"), alloc_bool(stats.kernel));
+	return o;
+}
+DEFINE_PRIM(_UdpSocket_GetBusyPollStats, 1);
+
+value _UdpSocket_SetPathMtuDiscovery(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_bool(s->SetPathMtuDiscovery(val_bool(b)));
+}
+DEFINE_PRIM(_UdpSocket_SetPathMtuDiscovery, 2);
+
+value _UdpSocket_GetPathMtu(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->GetPathMtu());
+}
+DEFINE_PRIM(_UdpSocket_GetPathMtu, 1);
+
+value _UdpSocket_SetFragmentSize(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	s->SetFragmentSize(val_int(b));
+	return alloc_null();
+}
+DEFINE_PRIM(_UdpSocket_SetFragmentSize, 2);
+
+value _UdpSocket_SetReassembly(value a, value b, value c, value d) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	s->SetReassembly(val_int(b), val_int(c), val_int(d));
+	return alloc_null();
+}
+DEFINE_PRIM(_UdpSocket_SetReassembly, 4);
+
+value _UdpSocket_SendMessage(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->SendMessage(buffer_data(val_to_buffer(b)), val_int(c)));
+}
+DEFINE_PRIM(_UdpSocket_SendMessage, 3);
+
+value _UdpSocket_ReceiveMessage(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->ReceiveMessage(buffer_data(val_to_buffer(b)), val_int(c)));
+}
+DEFINE_PRIM(_UdpSocket_ReceiveMessage, 3);
+
+value _UdpSocket_GetFragmentStats(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	FragmentStats stats = s->GetFragmentStats();
+	value o = alloc_empty_object();
+	alloc_field(o, val_id("messagesSent"), alloc_int(stats.messagesSent));
+	alloc_field(o, val_id("fragmentsSent"), alloc_int(stats.fragmentsSent));
+	alloc_field(o, val_id("completed"), alloc_int(stats.completed));
+	alloc_field(o, val_id("expired"), alloc_int(stats.expired));
+	alloc_field(o, val_id("evicted"), alloc_int(stats.evicted));
+	alloc_field(o, val_id("duplicates"), alloc_int(stats.duplicates));
+	alloc_field(o, val_id("invalid"), alloc_int(stats.invalid));
+	return o;
+}
+DEFINE_PRIM(_UdpSocket_GetFragmentStats, 1);
+
+value _UdpSocket_SetCoalescing(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	s->SetCoalescing(val_int(b), val_int(c));
+	return alloc_null();
+}
+DEFINE_PRIM(_UdpSocket_SetCoalescing, 3);
+
+value _UdpSocket_SendCoalesced(value a, value b, value c, value d) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->SendCoalesced(buffer_data(val_to_buffer(b)) + val_int(c), val_int(d)));
+}
+DEFINE_PRIM(_UdpSocket_SendCoalesced, 4);
+
+value _UdpSocket_FlushCoalesced(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->FlushCoalesced());
+}
+DEFINE_PRIM(_UdpSocket_FlushCoalesced, 1);
+
+value _UdpSocket_PumpCoalesced(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->PumpCoalesced());
+}
+DEFINE_PRIM(_UdpSocket_PumpCoalesced, 1);
+
+value _UdpSocket_GetCoalesceDelay(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->GetCoalesceDelay());
+}
+DEFINE_PRIM(_UdpSocket_GetCoalesceDelay, 1);
+
+value _UdpSocket_ReceiveCoalesced(value a, value b, value c, value d) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	vector<int> parts;
+	int ret = s->ReceiveCoalesced(buffer_data(val_to_buffer(b)), val_int(c), parts);
+	val_array_set_size(d, (int)parts.size());
+	for (size_t i = 0; i < parts.size(); i++)
+		val_array_set_i(d, (int)i, alloc_int(parts[i]));
+	return alloc_int(ret);
+}
+DEFINE_PRIM(_UdpSocket_ReceiveCoalesced, 4);
+
+value _UdpSocket_GetCoalesceStats(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	CoalesceStats stats = s->GetCoalesceStats();
+	value o = alloc_empty_object();
+	alloc_field(o, val_id("messages"), alloc_int(stats.messages));
+	alloc_field(o, val_id("datagrams"), alloc_int(stats.datagrams));
+	alloc_field(o, val_id("flushFull"), alloc_int(stats.flushFull));
+	alloc_field(o, val_id("flushDeadline"), alloc_int(stats.flushDeadline));
+	alloc_field(o, val_id("flushExplicit"), alloc_int(stats.flushExplicit));
+	alloc_field(o, val_id("discarded"), alloc_int(stats.discarded));
+	return o;
+}
+DEFINE_PRIM(_UdpSocket_GetCoalesceStats, 1);
+
+value _UdpSocket_SetPeerTable(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	s->SetPeerTable(val_int(b), val_int(c));
+	return alloc_null();
+}
+DEFINE_PRIM(_UdpSocket_SetPeerTable, 3);
+
+value _UdpSocket_GetPeerId(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->GetPeerId());
+}
+DEFINE_PRIM(_UdpSocket_GetPeerId, 1);
+
+value _UdpSocket_PollPeerEvents(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	vector<int> newPeers, expiredPeers;
+	s->PollPeerEvents(newPeers, expiredPeers);
+	val_array_set_size(b, (int)newPeers.size());
+	for (size_t i = 0; i < newPeers.size(); i++)
+		val_array_set_i(b, (int)i, alloc_int(newPeers[i]));
+	val_array_set_size(c, (int)expiredPeers.size());
+	for (size_t i = 0; i < expiredPeers.size(); i++)
+		val_array_set_i(c, (int)i, alloc_int(expiredPeers[i]));
+	return alloc_null();
+}
+DEFINE_PRIM(_UdpSocket_PollPeerEvents, 3);
+
+value _UdpSocket_GetPeerAddr(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	char address[INET_ADDRSTRLEN];
+	if (!s->GetPeerAddr(val_int(b), address)) return alloc_null();
+	return alloc_string(address);
+}
+DEFINE_PRIM(_UdpSocket_GetPeerAddr, 2);
+
+value _UdpSocket_GetPeerPort(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->GetPeerPort(val_int(b)));
+}
+DEFINE_PRIM(_UdpSocket_GetPeerPort, 2);
+
+value _UdpSocket_SendToPeer(value a, value b, value c, value d) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->SendToPeer(val_int(b), buffer_data(val_to_buffer(c)), val_int(d)));
+}
+DEFINE_PRIM(_UdpSocket_SendToPeer, 4);
+
+value _UdpSocket_GetPeerStats(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	PeerStats stats = s->GetPeerStats();
+	value o = alloc_empty_object();
+	alloc_field(o, val_id("active"), alloc_int(stats.active));
+	alloc_field(o, val_id("created"), alloc_int(stats.created));
+	alloc_field(o, val_id("expired"), alloc_int(stats.expired));
+	alloc_field(o, val_id("rejected"), alloc_int(stats.rejected));
+	return o;
+}
+DEFINE_PRIM(_UdpSocket_GetPeerStats, 1);
+
+value _UdpSocket_SetZeroCopy(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_bool(s->SetZeroCopy(val_bool(b), val_int(c)));
+}
+DEFINE_PRIM(_UdpSocket_SetZeroCopy, 3);
+
+value _UdpSocket_SendZeroCopy(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	int size = val_int(c);
+	value* root = NULL;
+	if (s->WantsZeroCopy(size)) {
+		root = alloc_root();
+		*root = b;
+	}
+	int ret = s->SendZeroCopy(buffer_data(val_to_buffer(b)), size, root);
+	if (ret < 0 && root) free_root(root);
+	return alloc_int(ret);
+}
+DEFINE_PRIM(_UdpSocket_SendZeroCopy, 3);
+
+value _UdpSocket_PollZeroCopy(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	vector<int> ids;
+	vector<void*> tokens;
+	int ret = s->PollZeroCopy(ids, tokens);
+	val_array_set_size(b, (int)ids.size());
+	for (size_t i = 0; i < ids.size(); i++) {
+		val_array_set_i(b, (int)i, alloc_int(ids[i]));
+		if (tokens[i]) free_root((value*)tokens[i]);
+	}
+	return alloc_int(ret);
+}
+DEFINE_PRIM(_UdpSocket_PollZeroCopy, 2);
+
+value _UdpSocket_GetZeroCopyStats(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	ZeroCopyStats stats = s->GetZeroCopyStats();
+	value o = alloc_empty_object();
+	alloc_field(o, val_id("sent"), alloc_int(stats.sent));
+	alloc_field(o, val_id("copied"), alloc_int(stats.copied));
+	alloc_field(o, val_id("completed"), alloc_int(stats.completed));
+	alloc_field(o, val_id("kernelCopied"), alloc_int(stats.kernelCopied));
+	alloc_field(o, val_id("pending"), alloc_int(stats.pending));
+	return o;
+}
+DEFINE_PRIM(_UdpSocket_GetZeroCopyStats, 1);
+
+value _UdpSocket_SetDemux(value a, value b, value c, value d) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_bool(s->SetDemux(val_int(b), val_int(c), val_int(d)));
+}
+DEFINE_PRIM(_UdpSocket_SetDemux, 4);
+
+value _UdpSocket_SetDemuxRoute(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_bool(s->SetDemuxRoute(val_int(b), val_int(c)));
+}
+DEFINE_PRIM(_UdpSocket_SetDemuxRoute, 3);
+
+value _UdpSocket_SetDemuxChannel(value a, value b, value c, value d) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_bool(s->SetDemuxChannel(val_int(b), val_int(c), val_int(d)));
+}
+DEFINE_PRIM(_UdpSocket_SetDemuxChannel, 4);
+
+value _UdpSocket_PumpDemux(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->PumpDemux(val_int(b)));
+}
+DEFINE_PRIM(_UdpSocket_PumpDemux, 2);
+
+value _UdpSocket_ReceiveChannel(value a, value b, value c, value d) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->ReceiveChannel(val_int(b), buffer_data(val_to_buffer(c)), val_int(d)));
+}
+DEFINE_PRIM(_UdpSocket_ReceiveChannel, 4);
+
+value _UdpSocket_GetDemuxPending(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->GetDemuxPending(val_int(b)));
+}
+DEFINE_PRIM(_UdpSocket_GetDemuxPending, 2);
+
+value _UdpSocket_GetDemuxStats(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	DemuxStats stats = s->GetDemuxStats();
+	value o = alloc_empty_object();
+	alloc_field(o, val_id("routed"), alloc_int(stats.routed));
+	alloc_field(o, val_id("unrouted"), alloc_int(stats.unrouted));
+	alloc_field(o, val_id("overflow"), alloc_int(stats.overflow));
+	alloc_field(o, val_id("truncated"), alloc_int(stats.truncated));
+	return o;
+}
+DEFINE_PRIM(_UdpSocket_GetDemuxStats, 1);
+
+value _UdpSocket_SetIncomingCpu(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_bool(s->SetIncomingCpu(val_int(b)));
+}
+DEFINE_PRIM(_UdpSocket_SetIncomingCpu, 2);
+
+value _UdpSocket_GetIncomingCpu(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->GetIncomingCpu());
+}
+DEFINE_PRIM(_UdpSocket_GetIncomingCpu, 1);
+
+value _UdpSocket_PinToIncomingCpu(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->PinToIncomingCpu());
+}
+DEFINE_PRIM(_UdpSocket_PinToIncomingCpu, 1);
+
+value _UdpSocket_PinThreadToCpu(value a) {
+	return alloc_bool(hxudpPinThreadToCpu(val_int(a)));
+}
+DEFINE_PRIM(_UdpSocket_PinThreadToCpu, 1);
+
+value _UdpSocket_GetCurrentCpu() {
+	return alloc_int(hxudpGetCurrentCpu());
+}
+DEFINE_PRIM(_UdpSocket_GetCurrentCpu, 0);
+
+value _UdpSocket_GetCpuCount() {
+	return alloc_int(hxudpGetCpuCount());
+}
+DEFINE_PRIM(_UdpSocket_GetCpuCount, 0);
+
+value _UdpSocket_GetCpuNumaNode(value a) {
+	return alloc_int(hxudpGetCpuNumaNode(val_int(a)));
+}
+DEFINE_PRIM(_UdpSocket_GetCpuNumaNode, 1);
+
+value _UdpSocket_StartRecording(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_bool(s->StartRecording(val_string(b), val_int(c)));
+}
+DEFINE_PRIM(_UdpSocket_StartRecording, 3);
+
+value _UdpSocket_StopRecording(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->StopRecording());
+}
+DEFINE_PRIM(_UdpSocket_StopRecording, 1);
+
+value _UdpSocket_Replay(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	std::string path = val_string(b);
+	double rate = val_float(c);
+	// the replay sleeps between packets; let the GC run meanwhile
+	gc_enter_blocking();
+	int sent = s->Replay(path.c_str(), rate);
+	gc_exit_blocking();
+	return alloc_int(sent);
+}
+DEFINE_PRIM(_UdpSocket_Replay, 3);
+
+double impairmentField(value o, const char* name) {
+	value v = val_field(o, val_id(name));
+	return val_is_null(v) ? 0 : val_number(v);
+}
+
+value _UdpSocket_SetImpairment(value a, value b, value c) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	ImpairmentConfig config;
+	memset(&config, 0, sizeof(config));
+	if (!val_is_null(c)) {
+		config.seed = (unsigned int)(int)impairmentField(c, "seed");
+		config.dropRate = impairmentField(c, "dropRate");
+		config.duplicateRate = impairmentField(c, "duplicateRate");
+		config.reorderRate = impairmentField(c, "reorderRate");
+		config.delayMicros = (int)impairmentField(c, "delayMicros");
+		config.jitterMicros = (int)impairmentField(c, "jitterMicros");
+		config.jitterDistribution = (int)impairmentField(c, "jitterDistribution");
+		config.bandwidth = (int)impairmentField(c, "bandwidth");
+	}
+	return alloc_bool(s->SetImpairment(val_int(b), config));
+}
+DEFINE_PRIM(_UdpSocket_SetImpairment, 3);
+
+value _UdpSocket_PumpImpairment(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->PumpImpairment());
+}
+DEFINE_PRIM(_UdpSocket_PumpImpairment, 1);
+
+value _UdpSocket_GetImpairmentDelay(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->GetImpairmentDelay());
+}
+DEFINE_PRIM(_UdpSocket_GetImpairmentDelay, 1);
+
+value _UdpSocket_FlushImpairment(value a) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	return alloc_int(s->FlushImpairment());
+}
+DEFINE_PRIM(_UdpSocket_FlushImpairment, 1);
+
+value _UdpSocket_GetImpairmentStats(value a, value b) {
+	UdpSocket* s = (UdpSocket*) val_data(a);
+	ImpairmentStats stats = s->GetImpairmentStats(val_int(b));
+	value o = alloc_empty_object();
+	alloc_field(o, val_id("passed"), alloc_int(stats.passed));
+	alloc_field(o, val_id("dropped"), alloc_int(stats.dropped));
+	alloc_field(o, val_id("duplicated"), alloc_int(stats.duplicated));
+	alloc_field(o, val_id("reordered"), alloc_int(stats.reordered));
+	alloc_field(o, val_id("overflow"), alloc_int(stats.overflow));
+	alloc_field(o, val_id("queued"), alloc_int(stats.queued));
+	return o;
+}
+DEFINE_PRIM(_UdpSocket_GetImpairmentStats, 2);
+
 extern "C" int hxudp_register_prims () { return 0; }
@@ -8,6 +8,133 @@ import cpp.Lib;
 import neko.Lib;
 #end
 
+typedef PacingStats = {
+	/** Datagrams put on the wire by the pacer. */
+	var sent:Int;
+	/** Datagrams that had to wait for their departure time. */
+	var delayed:Int;
+	/** Datagrams rejected because the pacing queue was full, or discarded by close(). */
+	var dropped:Int;
+	/** Datagrams currently waiting in the pacing queue. */
+	var queued:Int;
+	/** Bytes currently waiting in the pacing queue. */
+	var queuedBytes:Int;
+}
+
+typedef BusyPollStats = {
+	/** Microseconds spent spinning on a non-blocking receive in user space. */
+	var spinMicros:Float;
+	/** Microseconds spent in a blocking receive after the spin budget ran out, or in any receive in kernel mode. */
+	var sleepMicros:Float;
+	/** Datagrams received while spinning in user space. */
+	var spinHits:Int;
+	/** Datagrams received after falling back to a blocking wait, or by any receive in kernel mode. */
+	var sleepHits:Int;
+	/** Current adaptive spin budget in microseconds. */
+	var budget:Int;
+	/** The kernel accepted SO_BUSY_POLL; spinning then happens there and only the waits are measured. */
+	var kernel:Bool;
+}
+
+typedef FragmentStats = {
+	var messagesSent:Int;
+	var fragmentsSent:Int;
+	/** Messages reassembled and delivered by receiveMessage(). */
+	var completed:Int;
+	/** Partial messages dropped after the reassembly timeout. */
+	var expired:Int;
+	/** Partial messages dropped to make room in a full reassembly table. */
+	var evicted:Int;
+	/** Fragments received twice. */
+	var duplicates:Int;
+	/** Datagrams without a valid fragment header, or too large for the reassembly table. */
+	var invalid:Int;
+}
+
+typedef CoalesceStats = {
+	/** Messages handed to sendCoalesced(). */
+	var messages:Int;
+	/** Datagrams they were sent in. */
+	var datagrams:Int;
+	/** Flushes because the next message did not fit. */
+	var flushFull:Int;
+	/** Flushes because the deadline passed. */
+	var flushDeadline:Int;
+	/** Datagrams flushed by flushCoalesced(); flushes done by setCoalescing() are not counted. */
+	var flushExplicit:Int;
+	/** Pending messages lost because close() was called before they were flushed. */
+	var discarded:Int;
+}
+
+typedef PeerStats = {
+	/** Peers currently in the table. */
+	var active:Int;
+	/** Peers ever added. */
+	var created:Int;
+	/** Peers dropped for being idle. */
+	var expired:Int;
+	/** Datagrams from new senders while the table was full. */
+	var rejected:Int;
+}
+
+typedef ZeroCopyStats = {
+	/** Datagrams sent by reference. */
+	var sent:Int;
+	/** Datagrams copied because they were below the threshold or zero-copy was unavailable. */
+	var copied:Int;
+	/** Completions received. */
+	var completed:Int;
+	/** Completions where the kernel ended up copying anyway, e.g. on loopback. */
+	var kernelCopied:Int;
+	/** Buffers still owned by the kernel. */
+	var pending:Int;
+}
+
+typedef DemuxStats = {
+	/** Datagrams queued on a channel. */
+	var routed:Int;
+	/** Datagrams dropped for a short header, an unknown key or an unsubscribed channel. */
+	var unrouted:Int;
+	/** Datagrams dropped because their channel queue was full. */
+	var overflow:Int;
+	/** Datagrams cut to their channel's slot size. */
+	var truncated:Int;
+}
+
+typedef ImpairmentConfig = {
+	/** PRNG seed; the same seed and traffic give the same losses on every run. */
+	@:optional var seed:Int;
+	/** Probability that a datagram is lost. */
+	@:optional var dropRate:Float;
+	/** Probability that a datagram is delivered twice. */
+	@:optional var duplicateRate:Float;
+	/** Probability that a datagram skips the latency and overtakes those held before it. */
+	@:optional var reorderRate:Float;
+	/** Fixed one-way latency. */
+	@:optional var delayMicros:Int;
+	/** Spread of the latency: half-width when uniform, standard deviation when normal. */
+	@:optional var jitterMicros:Int;
+	/** UdpSocket.JITTER_UNIFORM (default) or UdpSocket.JITTER_NORMAL. */
+	@:optional var jitterDistribution:Int;
+	/** Link rate in bytes per second, 0 for unlimited. */
+	@:optional var bandwidth:Int;
+}
+
+typedef ImpairmentStats = {
+	/** Datagrams delivered, including duplicates. */
+	var passed:Int;
+	/** Datagrams lost on purpose. */
+	var dropped:Int;
+	/** Extra copies made. */
+	var duplicated:Int;
+	/** Datagrams that skipped the latency. */
+	var reordered:Int;
+	/** Datagrams lost because the queue was full. */
+	var overflow:Int;
+	/** Datagrams waiting for their release time. */
+	var queued:Int;
+}
+
 /**
  * UDP Socket Client (sending):
  * ------------------
@@ -54,6 +181,23 @@ import neko.Lib;
  * x) Close()
  */
 class UdpSocket {
+	/**
+	 * Returned by sendZeroCopy() when the datagram was copied and its buffer can be reused immediately.
+	 */
+	public static inline var ZEROCOPY_COPIED = -3;
+	
+	/**
+	 * Directions of setImpairment().
+	 */
+	public static inline var IMPAIR_SEND = 0;
+	public static inline var IMPAIR_RECEIVE = 1;
+	
+	/**
+	 * Latency jitter distributions of ImpairmentConfig.
+	 */
+	public static inline var JITTER_UNIFORM = 0;
+	public static inline var JITTER_NORMAL = 1;
+	
 	var handle:Dynamic;
 	
 	public function new():Void {
@@ -194,6 +338,10 @@ class UdpSocket {
 	static var _UdpSocket_SetNonBlocking = Lib.load("hxudp", "_UdpSocket_SetNonBlocking", 2);
 	
 	
+	/**
+	 * Largest payload a single datagram to the current destination can carry,
+	 * derived from the path MTU when the OS reports it.
+	 */
 	public function getMaxMsgSize():Int {
 		return _UdpSocket_GetMaxMsgSize(handle);
 	}
@@ -211,4 +359,488 @@ class UdpSocket {
 	}
 	static var _UdpSocket_SetTTL = Lib.load("hxudp", "_UdpSocket_SetTTL", 2);
 	
+	/**
+	 * Kernel-side rate cap (SO_MAX_PACING_RATE). Only enforced when the egress qdisc is fq.
+	 * 0 removes the cap.
+	 */
+	public function setMaxPacingRate(bytesPerSec:Int):Bool {
+		return _UdpSocket_SetMaxPacingRate(handle, bytesPerSec);
+	}
+	static var _UdpSocket_SetMaxPacingRate = Lib.load("hxudp", "_UdpSocket_SetMaxPacingRate", 2);
+	
+	/**
+	 * Paces send() to at most bytesPerSec and packetsPerSec (0 means unlimited, both 0 turns pacing off).
+	 * Datagrams that are not due yet are queued; call pumpPacing() regularly or flushPacing() to release them.
+	 */
+	public function setPacing(bytesPerSec:Int, packetsPerSec:Int):Void {
+		_UdpSocket_SetPacing(handle, bytesPerSec, packetsPerSec);
+	}
+	static var _UdpSocket_SetPacing = Lib.load("hxudp", "_UdpSocket_SetPacing", 3);
+	
+	/**
+	 * Hands paced departure times to the kernel (SO_TXTIME) instead of queueing them. Off by default.
+	 * Only the fq and etf qdiscs hold datagrams until their time; with any other qdisc (e.g. the default
+	 * fq_codel or pfifo_fast) they leave at once and pacing is lost, yet this still returns true.
+	 * Linux only, returns false if unsupported. close() turns it off.
+	 */
+	public function setTxTime(enable:Bool):Bool {
+		return _UdpSocket_SetTxTime(handle, enable);
+	}
+	static var _UdpSocket_SetTxTime = Lib.load("hxudp", "_UdpSocket_SetTxTime", 2);
+	
+	/**
+	 * Sends the queued datagrams that are due. Return the number of datagrams sent.
+	 */
+	public function pumpPacing():Int {
+		return _UdpSocket_PumpPacing(handle);
+	}
+	static var _UdpSocket_PumpPacing = Lib.load("hxudp", "_UdpSocket_PumpPacing", 1);
+	
+	/**
+	 * Microseconds until the next queued datagram is due, -1 if nothing is queued.
+	 */
+	public function getPacingDelay():Int {
+		return _UdpSocket_GetPacingDelay(handle);
+	}
+	static var _UdpSocket_GetPacingDelay = Lib.load("hxudp", "_UdpSocket_GetPacingDelay", 1);
+	
+	/**
+	 * Blocks until every queued datagram is sent. Return the number of datagrams sent.
+	 */
+	public function flushPacing():Int {
+		return _UdpSocket_FlushPacing(handle);
+	}
+	static var _UdpSocket_FlushPacing = Lib.load("hxudp", "_UdpSocket_FlushPacing", 1);
+	
+	
+	public function getPacingStats():PacingStats {
+		return _UdpSocket_GetPacingStats(handle);
+	}
+	static var _UdpSocket_GetPacingStats = Lib.load("hxudp", "_UdpSocket_GetPacingStats", 1);
+	
+	/**
+	 * Low latency receive. With preferKernel, uses SO_BUSY_POLL when the kernel permits it, otherwise
+	 * receive() spins for up to spinMicros before blocking. 0 turns it off.
+	 * Return true if the kernel accepted busy polling. Devices without NAPI (e.g. loopback) still
+	 * do not spin then; pass preferKernel = false to spin in user space regardless. In kernel mode every
+	 * receive counts as a sleep hit with its measured wait, since whether the kernel spun is unknown.
+	 */
+	public function setBusyPoll(spinMicros:Int, preferKernel:Bool = true):Bool {
+		return _UdpSocket_SetBusyPoll(handle, spinMicros, preferKernel);
+	}
+	static var _UdpSocket_SetBusyPoll = Lib.load("hxudp", "_UdpSocket_SetBusyPoll", 3);
+	
+	
+	public function getBusyPollStats():BusyPollStats {
+		return _UdpSocket_GetBusyPollStats(handle);
+	}
+	static var _UdpSocket_GetBusyPollStats = Lib.load("hxudp", "_UdpSocket_GetBusyPollStats", 1);
+	
+	/**
+	 * Sets DF on outgoing datagrams so the path MTU gets discovered and oversized sends fail
+	 * instead of being fragmented by IP.
+	 */
+	public function setPathMtuDiscovery(enable:Bool):Bool {
+		return _UdpSocket_SetPathMtuDiscovery(handle, enable);
+	}
+	static var _UdpSocket_SetPathMtuDiscovery = Lib.load("hxudp", "_UdpSocket_SetPathMtuDiscovery", 2);
+	
+	/**
+	 * Path MTU towards the current destination, -1 if unknown.
+	 */
+	public function getPathMtu():Int {
+		return _UdpSocket_GetPathMtu(handle);
+	}
+	static var _UdpSocket_GetPathMtu = Lib.load("hxudp", "_UdpSocket_GetPathMtu", 1);
+	
+	/**
+	 * Caps the datagram size sendMessage() produces. 0 follows the path MTU.
+	 */
+	public function setFragmentSize(bytes:Int):Void {
+		_UdpSocket_SetFragmentSize(handle, bytes);
+	}
+	static var _UdpSocket_SetFragmentSize = Lib.load("hxudp", "_UdpSocket_SetFragmentSize", 2);
+	
+	/**
+	 * Preallocates the receiveMessage() reassembly table: `slots` messages in flight of at most
+	 * maxMessageSize bytes each, dropped if incomplete after timeoutMs (0 never drops them).
+	 * Defaults to 16 slots of 256KB and 2 seconds.
+	 */
+	public function setReassembly(slots:Int, maxMessageSize:Int, timeoutMs:Int):Void {
+		_UdpSocket_SetReassembly(handle, slots, maxMessageSize, timeoutMs);
+	}
+	static var _UdpSocket_SetReassembly = Lib.load("hxudp", "_UdpSocket_SetReassembly", 4);
+	
+	/**
+	 * Sends a message larger than the path MTU as several datagrams.
+	 * The peer must read it with receiveMessage(). Return the message size.
+	 */
+	public function sendMessage(pBuff:Bytes):Int {
+		return _UdpSocket_SendMessage(handle, pBuff.getData(), pBuff.length);
+	}
+	static var _UdpSocket_SendMessage = Lib.load("hxudp", "_UdpSocket_SendMessage", 3);
+	
+	/**
+	 * Receives the next complete message sent with sendMessage().
+	 * Return the message size, truncated to pBuff.length.
+	 */
+	public function receiveMessage(pBuff:Bytes):Int {
+		return _UdpSocket_ReceiveMessage(handle, pBuff.getData(), pBuff.length);
+	}
+	static var _UdpSocket_ReceiveMessage = Lib.load("hxudp", "_UdpSocket_ReceiveMessage", 3);
+	
+	
+	public function getFragmentStats():FragmentStats {
+		return _UdpSocket_GetFragmentStats(handle);
+	}
+	static var _UdpSocket_GetFragmentStats = Lib.load("hxudp", "_UdpSocket_GetFragmentStats", 1);
+	
+	/**
+	 * Configures sendCoalesced(): small messages to the same destination are packed into
+	 * datagrams of up to datagramSize bytes (0 follows the path MTU) and held for at most
+	 * deadlineMicros (0 holds them until full or flushed). A negative datagramSize turns it off.
+	 * The receiver must turn it on too, or receiveCoalesced() returns each datagram whole.
+	 * Deadlines are checked by sendCoalesced() and pumpCoalesced(); there is no background timer.
+	 * close() discards the messages still pending and counts them in CoalesceStats.discarded.
+	 */
+	public function setCoalescing(datagramSize:Int, deadlineMicros:Int):Void {
+		_UdpSocket_SetCoalescing(handle, datagramSize, deadlineMicros);
+	}
+	static var _UdpSocket_SetCoalescing = Lib.load("hxudp", "_UdpSocket_SetCoalescing", 3);
+	
+	/**
+	 * Queues a message for the current destination. Return the message length.
+	 */
+	public function sendCoalesced(pBuff:Bytes, pos:Int = 0, len:Int = -1):Int {
+		if (len < 0) len = pBuff.length - pos;
+		if (pos < 0 || pos + len > pBuff.length) throw "out of bounds";
+		return _UdpSocket_SendCoalesced(handle, pBuff.getData(), pos, len);
+	}
+	static var _UdpSocket_SendCoalesced = Lib.load("hxudp", "_UdpSocket_SendCoalesced", 4);
+	
+	/**
+	 * Sends everything that is pending. Return the number of datagrams sent.
+	 */
+	public function flushCoalesced():Int {
+		return _UdpSocket_FlushCoalesced(handle);
+	}
+	static var _UdpSocket_FlushCoalesced = Lib.load("hxudp", "_UdpSocket_FlushCoalesced", 1);
+	
+	/**
+	 * Sends what has waited past its deadline. Return the number of datagrams sent.
+	 */
+	public function pumpCoalesced():Int {
+		return _UdpSocket_PumpCoalesced(handle);
+	}
+	static var _UdpSocket_PumpCoalesced = Lib.load("hxudp", "_UdpSocket_PumpCoalesced", 1);
+	
+	/**
+	 * Microseconds until the earliest pending deadline, -1 if none.
+	 */
+	public function getCoalesceDelay():Int {
+		return _UdpSocket_GetCoalesceDelay(handle);
+	}
+	static var _UdpSocket_GetCoalesceDelay = Lib.load("hxudp", "_UdpSocket_GetCoalesceDelay", 1);
+	
+	/**
+	 * Receives one datagram into pBuff and fills parts with the offset and length of every
+	 * message packed in it, as consecutive pairs. The messages are not copied.
+	 * Return the number of messages.
+	 */
+	public function receiveCoalesced(pBuff:Bytes, parts:Array<Int>):Int {
+		return _UdpSocket_ReceiveCoalesced(handle, pBuff.getData(), pBuff.length, parts);
+	}
+	static var _UdpSocket_ReceiveCoalesced = Lib.load("hxudp", "_UdpSocket_ReceiveCoalesced", 4);
+	
+	
+	public function getCoalesceStats():CoalesceStats {
+		return _UdpSocket_GetCoalesceStats(handle);
+	}
+	static var _UdpSocket_GetCoalesceStats = Lib.load("hxudp", "_UdpSocket_GetCoalesceStats", 1);
+	
+	/**
+	 * Tracks senders natively so every received datagram gets a small integer peer id
+	 * (0 until capacity), see getPeerId(). Peers idle for idleTimeoutMs are dropped
+	 * (0 keeps them). A capacity of 0 turns the table off.
+	 */
+	public function setPeerTable(capacity:Int, idleTimeoutMs:Int):Void {
+		_UdpSocket_SetPeerTable(handle, capacity, idleTimeoutMs);
+	}
+	static var _UdpSocket_SetPeerTable = Lib.load("hxudp", "_UdpSocket_SetPeerTable", 3);
+	
+	/**
+	 * Peer id of the last received packet, -1 if the table is off or was full.
+	 */
+	public function getPeerId():Int {
+		return _UdpSocket_GetPeerId(handle);
+	}
+	static var _UdpSocket_GetPeerId = Lib.load("hxudp", "_UdpSocket_GetPeerId", 1);
+	
+	/**
+	 * Fills newPeers and expiredPeers with the ids added and expired since the last call.
+	 * An expired id is not handed out again before it has been reported here, so both lists
+	 * stay under the table capacity; but with an idle timeout, a table that is never polled
+	 * fills up with expired ids and then rejects every new sender. Call it regularly.
+	 */
+	public function pollPeerEvents(newPeers:Array<Int>, expiredPeers:Array<Int>):Void {
+		_UdpSocket_PollPeerEvents(handle, newPeers, expiredPeers);
+	}
+	static var _UdpSocket_PollPeerEvents = Lib.load("hxudp", "_UdpSocket_PollPeerEvents", 3);
+	
+	/**
+	 * IP of a peer, null if the id is not in use.
+	 */
+	public function getPeerAddr(id:Int):String {
+		return _UdpSocket_GetPeerAddr(handle, id);
+	}
+	static var _UdpSocket_GetPeerAddr = Lib.load("hxudp", "_UdpSocket_GetPeerAddr", 2);
+	
+	/**
+	 * Port of a peer, -1 if the id is not in use.
+	 */
+	public function getPeerPort(id:Int):Int {
+		return _UdpSocket_GetPeerPort(handle, id);
+	}
+	static var _UdpSocket_GetPeerPort = Lib.load("hxudp", "_UdpSocket_GetPeerPort", 2);
+	
+	/**
+	 * Return the number of Bytes it sent.
+	 */
+	public function sendToPeer(id:Int, pBuff:Bytes):Int {
+		return _UdpSocket_SendToPeer(handle, id, pBuff.getData(), pBuff.length);
+	}
+	static var _UdpSocket_SendToPeer = Lib.load("hxudp", "_UdpSocket_SendToPeer", 4);
+	
+	
+	public function getPeerStats():PeerStats {
+		return _UdpSocket_GetPeerStats(handle);
+	}
+	static var _UdpSocket_GetPeerStats = Lib.load("hxudp", "_UdpSocket_GetPeerStats", 1);
+	
+	/**
+	 * Enables MSG_ZEROCOPY for sendZeroCopy() on datagrams of at least thresholdBytes
+	 * (never below 16KB). Linux only, returns false if unsupported.
+	 * close() turns it off and resets the statistics; call it again after create().
+	 */
+	public function setZeroCopy(enable:Bool, thresholdBytes:Int):Bool {
+		return _UdpSocket_SetZeroCopy(handle, enable, thresholdBytes);
+	}
+	static var _UdpSocket_SetZeroCopy = Lib.load("hxudp", "_UdpSocket_SetZeroCopy", 3);
+	
+	/**
+	 * Sends pBuff without copying it into the kernel when it is large enough.
+	 * Return a completion id >= 0 if the buffer is now owned by the kernel: do not modify it
+	 * until pollZeroCopy() reports that id. Return ZEROCOPY_COPIED if it was copied and can be
+	 * reused right away, -1 on error.
+	 */
+	public function sendZeroCopy(pBuff:Bytes):Int {
+		return _UdpSocket_SendZeroCopy(handle, pBuff.getData(), pBuff.length);
+	}
+	static var _UdpSocket_SendZeroCopy = Lib.load("hxudp", "_UdpSocket_SendZeroCopy", 3);
+	
+	/**
+	 * Fills completed with the ids of the buffers the kernel released since the last call.
+	 * Never blocks. Return the number of ids.
+	 */
+	public function pollZeroCopy(completed:Array<Int>):Int {
+		return _UdpSocket_PollZeroCopy(handle, completed);
+	}
+	static var _UdpSocket_PollZeroCopy = Lib.load("hxudp", "_UdpSocket_PollZeroCopy", 2);
+	
+	
+	public function getZeroCopyStats():ZeroCopyStats {
+		return _UdpSocket_GetZeroCopyStats(handle);
+	}
+	static var _UdpSocket_GetZeroCopyStats = Lib.load("hxudp", "_UdpSocket_GetZeroCopyStats", 1);
+	
+	/**
+	 * Routes received datagrams to channel queues by a header field: `width` bytes (1 to 4) at
+	 * `offset`, big-endian, masked with `mask` (0 keeps every bit) and shifted down to the mask's
+	 * lowest bit. That key is mapped to a channel with setDemuxRoute(). A width of 0 turns it off.
+	 * Return false if the mask has bits outside the field or spans more than 65536 keys.
+	 * Only receiveChannel() and pumpDemux() route; plain receive() still returns every datagram.
+	 */
+	public function setDemux(offset:Int, width:Int, mask:Int):Bool {
+		return _UdpSocket_SetDemux(handle, offset, width, mask);
+	}
+	static var _UdpSocket_SetDemux = Lib.load("hxudp", "_UdpSocket_SetDemux", 4);
+	
+	/**
+	 * Sends datagrams with this key to channel, or drops them if channel is -1.
+	 * key and channel must both be below the key count of setDemux().
+	 */
+	public function setDemuxRoute(key:Int, channel:Int):Bool {
+		return _UdpSocket_SetDemuxRoute(handle, key, channel);
+	}
+	static var _UdpSocket_SetDemuxRoute = Lib.load("hxudp", "_UdpSocket_SetDemuxRoute", 3);
+	
+	/**
+	 * Subscribes to a channel with a queue of `slots` datagrams of up to slotSize bytes.
+	 * 0 slots unsubscribes, and its datagrams are dropped natively.
+	 * Return false if demux is off or channel is not below its key count.
+	 */
+	public function setDemuxChannel(channel:Int, slots:Int, slotSize:Int):Bool {
+		return _UdpSocket_SetDemuxChannel(handle, channel, slots, slotSize);
+	}
+	static var _UdpSocket_SetDemuxChannel = Lib.load("hxudp", "_UdpSocket_SetDemuxChannel", 4);
+	
+	/**
+	 * Routes up to maxDatagrams pending datagrams without blocking. Return how many were read.
+	 */
+	public function pumpDemux(maxDatagrams:Int):Int {
+		return _UdpSocket_PumpDemux(handle, maxDatagrams);
+	}
+	static var _UdpSocket_PumpDemux = Lib.load("hxudp", "_UdpSocket_PumpDemux", 2);
+	
+	/**
+	 * Receives the next datagram of a channel, reading and routing from the socket while its
+	 * queue is empty. Return the datagram size.
+	 */
+	public function receiveChannel(channel:Int, pBuff:Bytes):Int {
+		return _UdpSocket_ReceiveChannel(handle, channel, pBuff.getData(), pBuff.length);
+	}
+	static var _UdpSocket_ReceiveChannel = Lib.load("hxudp", "_UdpSocket_ReceiveChannel", 4);
+	
+	
+	public function getDemuxPending(channel:Int):Int {
+		return _UdpSocket_GetDemuxPending(handle, channel);
+	}
+	static var _UdpSocket_GetDemuxPending = Lib.load("hxudp", "_UdpSocket_GetDemuxPending", 2);
+	
+	
+	public function getDemuxStats():DemuxStats {
+		return _UdpSocket_GetDemuxStats(handle);
+	}
+	static var _UdpSocket_GetDemuxStats = Lib.load("hxudp", "_UdpSocket_GetDemuxStats", 1);
+	
+	/**
+	 * SO_INCOMING_CPU: within a SO_REUSEPORT group, prefer this socket for packets processed on cpu.
+	 * Linux only.
+	 */
+	public function setIncomingCpu(cpu:Int):Bool {
+		return _UdpSocket_SetIncomingCpu(handle, cpu);
+	}
+	static var _UdpSocket_SetIncomingCpu = Lib.load("hxudp", "_UdpSocket_SetIncomingCpu", 2);
+	
+	/**
+	 * CPU that processed the last packet received on this socket, i.e. the RSS queue
+	 * delivering its traffic. -1 if unknown. Linux only measures it on connected sockets and
+	 * connect() does not connect the underlying socket, so this is -1 for sockets made by this class.
+	 */
+	public function getIncomingCpu():Int {
+		return _UdpSocket_GetIncomingCpu(handle);
+	}
+	static var _UdpSocket_GetIncomingCpu = Lib.load("hxudp", "_UdpSocket_GetIncomingCpu", 1);
+	
+	/**
+	 * Pins the calling thread to getIncomingCpu(). Return that CPU, -1 if it is unknown or on failure.
+	 */
+	public function pinToIncomingCpu():Int {
+		return _UdpSocket_PinToIncomingCpu(handle);
+	}
+	static var _UdpSocket_PinToIncomingCpu = Lib.load("hxudp", "_UdpSocket_PinToIncomingCpu", 1);
+	
+	/**
+	 * Pins the calling thread to a CPU, or unpins it with -1. Linux and Windows only.
+	 */
+	public static function pinThreadToCpu(cpu:Int):Bool {
+		return _UdpSocket_PinThreadToCpu(cpu);
+	}
+	static var _UdpSocket_PinThreadToCpu = Lib.load("hxudp", "_UdpSocket_PinThreadToCpu", 1);
+	
+	/**
+	 * CPU the calling thread is running on, -1 if unknown.
+	 */
+	public static function getCurrentCpu():Int {
+		return _UdpSocket_GetCurrentCpu();
+	}
+	static var _UdpSocket_GetCurrentCpu = Lib.load("hxudp", "_UdpSocket_GetCurrentCpu", 0);
+	
+	/**
+	 * Number of CPUs in the system.
+	 */
+	public static function getCpuCount():Int {
+		return _UdpSocket_GetCpuCount();
+	}
+	static var _UdpSocket_GetCpuCount = Lib.load("hxudp", "_UdpSocket_GetCpuCount", 0);
+	
+	/**
+	 * NUMA node of a CPU, -1 if unknown. Linux only.
+	 */
+	public static function getCpuNumaNode(cpu:Int):Int {
+		return _UdpSocket_GetCpuNumaNode(cpu);
+	}
+	static var _UdpSocket_GetCpuNumaNode = Lib.load("hxudp", "_UdpSocket_GetCpuNumaNode", 1);
+	
+	/**
+	 * Captures every datagram this socket receives, with timestamp and sender, to a pcap file.
+	 * The file is memory-mapped and grows from initialBytes (0 for 64MB) as needed.
+	 * The destination written is the bound address: 0.0.0.0 unless bound to a specific one.
+	 */
+	public function startRecording(path:String, initialBytes:Int = 0):Bool {
+		return _UdpSocket_StartRecording(handle, path, initialBytes);
+	}
+	static var _UdpSocket_StartRecording = Lib.load("hxudp", "_UdpSocket_StartRecording", 3);
+	
+	/**
+	 * Finishes the capture. Return the number of datagrams recorded.
+	 */
+	public function stopRecording():Int {
+		return _UdpSocket_StopRecording(handle);
+	}
+	static var _UdpSocket_StopRecording = Lib.load("hxudp", "_UdpSocket_StopRecording", 1);
+	
+	/**
+	 * Sends the UDP payloads of a pcap file (raw IPv4 or Ethernet) to the connected destination,
+	 * with the recorded timing sped up by rate (1 is the original pace, 0 is as fast as possible).
+	 * Microsecond and nanosecond captures are accepted; a record over the snapshot length or 65535 bytes
+	 * ends the replay. Blocks until done. Return the number of datagrams sent, -1 if the file cannot be read.
+	 */
+	public function replay(path:String, rate:Float):Int {
+		return _UdpSocket_Replay(handle, path, rate);
+	}
+	static var _UdpSocket_Replay = Lib.load("hxudp", "_UdpSocket_Replay", 3);
+	
+	/**
+	 * Emulates a bad network on one direction (IMPAIR_SEND or IMPAIR_RECEIVE) of this socket, for testing:
+	 * loss, duplication, reordering, latency with jitter and a bandwidth cap, all drawn from config.seed.
+	 * null or an empty config turns it off. Datagrams held on the send side go out on the next send(), sendAll()
+	 * or other send, or on pumpImpairment() and flushImpairment(); those held on the receive side are delivered
+	 * by receive(), receiveMessage(), receiveCoalesced(), receiveChannel() and pumpDemux().
+	 * close() turns both directions off and counts the datagrams still held as dropped.
+	 */
+	public function setImpairment(direction:Int, config:Null<ImpairmentConfig>):Bool {
+		return _UdpSocket_SetImpairment(handle, direction, config);
+	}
+	static var _UdpSocket_SetImpairment = Lib.load("hxudp", "_UdpSocket_SetImpairment", 3);
+	
+	/**
+	 * Sends the held datagrams that are due. Return the number of datagrams sent.
+	 */
+	public function pumpImpairment():Int {
+		return _UdpSocket_PumpImpairment(handle);
+	}
+	static var _UdpSocket_PumpImpairment = Lib.load("hxudp", "_UdpSocket_PumpImpairment", 1);
+	
+	/**
+	 * Microseconds until the next held datagram of either direction is due, -1 if nothing is held.
+	 */
+	public function getImpairmentDelay():Int {
+		return _UdpSocket_GetImpairmentDelay(handle);
+	}
+	static var _UdpSocket_GetImpairmentDelay = Lib.load("hxudp", "_UdpSocket_GetImpairmentDelay", 1);
+	
+	/**
+	 * Blocks until every datagram held on the send side is sent. Return the number of datagrams sent.
+	 */
+	public function flushImpairment():Int {
+		return _UdpSocket_FlushImpairment(handle);
+	}
+	static var _UdpSocket_FlushImpairment = Lib.load("hxudp", "_UdpSocket_FlushImpairment", 1);
+	
+	public function getImpairmentStats(direction:Int):ImpairmentStats {
+		return _UdpSocket_GetImpairmentStats(handle, direction);
+	}
+	static var _UdpSocket_GetImpairmentStats = Lib.load("hxudp", "_UdpSocket_GetImpairmentStats", 2);
+	
 }
\ No newline at end of file
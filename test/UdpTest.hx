@@ -26,7 +26,7 @@ class UdpTest extends TestCase {
 		assertTrue(s.create());
 		assertTrue(s.bind(11999));
 		assertTrue(s.setNonBlocking(false));
-		// assertTrue(s.getMaxMsgSize() > 0); // this crashes on OSX...
+		assertTrue(s.getMaxMsgSize() > 0);
 		assertTrue(s.getReceiveBufferSize() > 0);
 		
 		mainThread.sendMessage(true); //notify server is ready
@@ -69,6 +69,550 @@ class UdpTest extends TestCase {
 		while (!lock.wait(1)) {}
 	}
 
+	function testPacing():Void {
+		var count = 11;
+		var packetsPerSec = 50;
+
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12000));
+		assertTrue(r.setNonBlocking(false));
+
+		var s = new UdpSocket();
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12000));
+		s.setPacing(0, packetsPerSec);
+
+		var payload = Bytes.alloc(100);
+		var start = haxe.Timer.stamp();
+		for (i in 0...count) {
+			assertEquals(payload.length, s.send(payload));
+		}
+		s.flushPacing();
+		var elapsed = haxe.Timer.stamp() - start;
+
+		//the first datagram leaves immediately, the rest one interval apart
+		assertTrue(elapsed >= (count - 1) / packetsPerSec * 0.9);
+		var stats = s.getPacingStats();
+		assertEquals(count, stats.sent);
+		assertEquals(0, stats.queued);
+
+		var b = Bytes.alloc(200);
+		for (i in 0...count) {
+			assertEquals(payload.length, r.receive(b));
+		}
+
+		//sendAll() goes through the same pacer
+		start = haxe.Timer.stamp();
+		for (i in 0...count) {
+			assertEquals(payload.length, s.sendAll(payload));
+		}
+		s.flushPacing();
+		elapsed = haxe.Timer.stamp() - start;
+		assertTrue(elapsed >= (count - 1) / packetsPerSec * 0.9);
+		assertEquals(count * 2, s.getPacingStats().sent);
+		for (i in 0...count) {
+			assertEquals(payload.length, r.receive(b));
+		}
+
+		//byte rate: each datagram waits for the previous one's size / bytesPerSec
+		var bytesPerSec = 5000;
+		s.setPacing(bytesPerSec, 0);
+		start = haxe.Timer.stamp();
+		for (i in 0...count) {
+			assertEquals(payload.length, s.send(payload));
+		}
+		s.flushPacing();
+		elapsed = haxe.Timer.stamp() - start;
+		assertTrue(elapsed >= (count - 1) * payload.length / bytesPerSec * 0.9);
+		assertEquals(count * 3, s.getPacingStats().sent);
+		for (i in 0...count) {
+			assertEquals(payload.length, r.receive(b));
+		}
+
+		//kernel departure times do not outlive the socket they were enabled on
+		if (s.setTxTime(true)) {
+			assertTrue(s.close());
+			assertTrue(s.create());
+			assertTrue(s.connect("127.0.0.1", 12000));
+			assertEquals(payload.length, s.send(payload));
+			assertEquals(payload.length, s.send(payload));
+			s.flushPacing();
+			assertEquals(payload.length, r.receive(b));
+			assertEquals(payload.length, r.receive(b));
+		}
+
+		assertTrue(s.close());
+		assertTrue(r.close());
+	}
+
+	function testBusyPoll():Void {
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12001));
+		assertTrue(r.setNonBlocking(false));
+		var kernel = r.setBusyPoll(1000);
+
+		var s = new UdpSocket();
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12001));
+		assertEquals(msg1.length, s.send(Bytes.ofString(msg1)));
+
+		var b = Bytes.alloc(80);
+		assertEquals(msg1.length, r.receive(b));
+
+		var stats = r.getBusyPollStats();
+		assertEquals(kernel, stats.kernel);
+		assertEquals(1, stats.spinHits + stats.sleepHits);
+		if (kernel) {
+			//nothing was measured spinning in user space
+			assertEquals(0, stats.spinHits);
+			assertEquals(0.0, stats.spinMicros);
+		}
+
+		//user-space spin: a miss halves the budget, a hit doubles it back
+		assertFalse(r.setBusyPoll(2000, false));
+		assertTrue(r.setNonBlocking(true));
+		assertTrue(r.receive(b) < 0);
+		stats = r.getBusyPollStats();
+		assertFalse(stats.kernel);
+		assertEquals(0, stats.spinHits);
+		assertEquals(1000, stats.budget);
+		assertTrue(stats.spinMicros >= 2000);
+
+		assertEquals(msg1.length, s.send(Bytes.ofString(msg1)));
+		Sys.sleep(0.01);
+		assertEquals(msg1.length, r.receive(b));
+		stats = r.getBusyPollStats();
+		assertEquals(1, stats.spinHits);
+		assertEquals(0, stats.sleepHits);
+		assertEquals(2000, stats.budget);
+
+		assertTrue(s.close());
+		assertTrue(r.close());
+	}
+
+	function testMessage():Void {
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12002));
+		assertTrue(r.setNonBlocking(false));
+		r.setReassembly(4, 64 * 1024, 1000);
+
+		var s = new UdpSocket();
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12002));
+		s.setPathMtuDiscovery(true);
+		assertTrue(s.getMaxMsgSize() > 0);
+		s.setFragmentSize(512);
+
+		var msg = Bytes.alloc(5000);
+		for (i in 0...msg.length) msg.set(i, i * 7);
+		assertEquals(msg.length, s.sendMessage(msg));
+
+		var b = Bytes.alloc(8000);
+		assertEquals(msg.length, r.receiveMessage(b));
+		assertEquals(0, b.sub(0, msg.length).compare(msg));
+		assertEquals(1, r.getFragmentStats().completed);
+		assertTrue(s.getFragmentStats().fragmentsSent > 1);
+
+		//a timeout of 0 never expires partial messages
+		r.setReassembly(4, 64 * 1024, 0);
+		assertEquals(msg.length, s.sendMessage(msg));
+		assertEquals(msg.length, r.receiveMessage(b));
+		assertEquals(2, r.getFragmentStats().completed);
+		assertEquals(0, r.getFragmentStats().expired);
+
+		assertTrue(s.close());
+		assertTrue(r.close());
+	}
+
+	function testCoalescing():Void {
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12003));
+		assertTrue(r.setNonBlocking(false));
+		r.setCoalescing(0, 0);
+
+		var s = new UdpSocket();
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12003));
+		s.setCoalescing(200, 0);
+
+		var count = 10;
+		for (i in 0...count) {
+			assertEquals(msg1.length, s.sendCoalesced(Bytes.ofString(msg1)));
+		}
+		assertEquals(1, s.flushCoalesced());
+		assertEquals(1, s.getCoalesceStats().datagrams);
+
+		var b = Bytes.alloc(300);
+		var parts = [];
+		assertEquals(count, r.receiveCoalesced(b, parts));
+		for (i in 0...count) {
+			assertEquals(msg1, b.getString(parts[i * 2], parts[i * 2 + 1]));
+		}
+
+		//one buffer per destination is allocated and freed again once flushed
+		var t = new UdpSocket();
+		assertTrue(t.create());
+		assertTrue(t.bind(12013));
+		for (port in [12003, 12013]) {
+			assertTrue(s.connect("127.0.0.1", port));
+			assertEquals(msg1.length, s.sendCoalesced(Bytes.ofString(msg1)));
+		}
+		s.setCoalescing(-1, 0);
+		var stats = s.getCoalesceStats();
+		assertEquals(3, stats.datagrams);
+		assertEquals(1, stats.flushExplicit);
+		assertEquals(1, r.receiveCoalesced(b, parts));
+		assertEquals(1, t.receiveCoalesced(b, parts));
+
+		//with coalescing off, a payload that happens to be validly framed is left whole
+		r.setCoalescing(-1, 0);
+		assertTrue(s.connect("127.0.0.1", 12003));
+		var fake = Bytes.alloc(5);
+		fake.set(0, "H".code);
+		fake.set(1, "C".code);
+		fake.set(2, 0);
+		fake.set(3, 1);
+		fake.set(4, "x".code);
+		assertEquals(fake.length, s.sendCoalesced(fake));
+		assertEquals(1, r.receiveCoalesced(b, parts));
+		assertEquals(0, parts[0]);
+		assertEquals(fake.length, parts[1]);
+
+		//close() discards what is still pending instead of sending it on the next socket
+		s.setCoalescing(200, 0);
+		assertEquals(msg1.length, s.sendCoalesced(Bytes.ofString(msg1)));
+		assertEquals(msg2.length, s.sendCoalesced(Bytes.ofString(msg2)));
+		assertTrue(s.close());
+		assertEquals(2, s.getCoalesceStats().discarded);
+		assertTrue(s.create());
+		assertEquals(0, s.flushCoalesced());
+
+		assertTrue(t.close());
+		assertTrue(s.close());
+		assertTrue(r.close());
+	}
+
+	function testPeerTable():Void {
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12004));
+		assertTrue(r.setNonBlocking(false));
+		r.setPeerTable(16, 0);
+
+		var a = new UdpSocket();
+		assertTrue(a.create());
+		assertTrue(a.connect("127.0.0.1", 12004));
+		var c = new UdpSocket();
+		assertTrue(c.create());
+		assertTrue(c.connect("127.0.0.1", 12004));
+
+		var b = Bytes.alloc(80);
+		a.send(Bytes.ofString(msg1));
+		r.receive(b);
+		var idA = r.getPeerId();
+		c.send(Bytes.ofString(msg1));
+		r.receive(b);
+		var idC = r.getPeerId();
+		a.send(Bytes.ofString(msg1));
+		r.receive(b);
+		assertEquals(idA, r.getPeerId());
+		assertTrue(idA >= 0 && idC >= 0 && idA != idC);
+
+		var added = [], expired = [];
+		r.pollPeerEvents(added, expired);
+		assertEquals(2, added.length);
+		assertEquals(0, expired.length);
+		assertEquals("127.0.0.1", r.getPeerAddr(idC));
+
+		assertEquals(msg2.length, r.sendToPeer(idC, Bytes.ofString(msg2)));
+		assertEquals(msg2.length, c.receive(b));
+
+		assertTrue(a.close());
+		assertTrue(c.close());
+		assertTrue(r.close());
+	}
+
+	function testPeerExpiry():Void {
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12014));
+		assertTrue(r.setNonBlocking(false));
+		r.setPeerTable(4, 100);
+
+		var a = new UdpSocket();
+		assertTrue(a.create());
+		assertTrue(a.connect("127.0.0.1", 12014));
+		var c = new UdpSocket();
+		assertTrue(c.create());
+		assertTrue(c.connect("127.0.0.1", 12014));
+		var d = new UdpSocket();
+		assertTrue(d.create());
+		assertTrue(d.connect("127.0.0.1", 12014));
+
+		var b = Bytes.alloc(80);
+		a.send(Bytes.ofString(msg1));
+		r.receive(b);
+		var idA = r.getPeerId();
+		c.send(Bytes.ofString(msg1));
+		r.receive(b);
+		var idC = r.getPeerId();
+
+		//a keeps talking, c goes quiet for longer than the idle timeout
+		Sys.sleep(0.06);
+		a.send(Bytes.ofString(msg1));
+		r.receive(b);
+		assertEquals(idA, r.getPeerId());
+		Sys.sleep(0.06);
+
+		var added = [], expired = [];
+		r.pollPeerEvents(added, expired);
+		assertEquals(2, added.length);
+		assertEquals(1, expired.length);
+		assertEquals(idC, expired[0]);
+
+		//a survived the removal of c from the hash table
+		a.send(Bytes.ofString(msg1));
+		r.receive(b);
+		assertEquals(idA, r.getPeerId());
+
+		//c's id is free again once reported
+		d.send(Bytes.ofString(msg1));
+		r.receive(b);
+		assertEquals(idC, r.getPeerId());
+
+		var stats = r.getPeerStats();
+		assertEquals(2, stats.active);
+		assertEquals(3, stats.created);
+		assertEquals(1, stats.expired);
+
+		assertTrue(a.close());
+		assertTrue(c.close());
+		assertTrue(d.close());
+		assertTrue(r.close());
+	}
+
+	function testZeroCopy():Void {
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12005));
+		assertTrue(r.setNonBlocking(false));
+		assertTrue(r.setReceiveBufferSize(256 * 1024));
+
+		var s = new UdpSocket();
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12005));
+		var enabled = s.setZeroCopy(true, 0);
+
+		var payload = Bytes.alloc(60000);
+		var id = s.sendZeroCopy(payload);
+		assertTrue(id >= 0 || id == UdpSocket.ZEROCOPY_COPIED);
+		assertEquals(UdpSocket.ZEROCOPY_COPIED, s.sendZeroCopy(Bytes.ofString(msg1)));
+
+		if (id >= 0) {
+			assertTrue(enabled);
+			var completed = [];
+			var tries = 0;
+			while (s.getZeroCopyStats().pending > 0 && tries++ < 100) {
+				s.pollZeroCopy(completed);
+				Sys.sleep(0.01);
+			}
+			assertEquals(0, s.getZeroCopyStats().pending);
+		}
+
+		var b = Bytes.alloc(65536);
+		assertEquals(payload.length, r.receive(b));
+		assertEquals(msg1.length, r.receive(b));
+
+		//close() waits for the kernel to release buffers nobody polled for, then starts over
+		s.sendZeroCopy(payload);
+		assertTrue(s.close());
+		assertEquals(0, s.getZeroCopyStats().pending);
+		assertEquals(payload.length, r.receive(b));
+
+		//a recreated socket copies until zero-copy is enabled on it again
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12005));
+		assertEquals(UdpSocket.ZEROCOPY_COPIED, s.sendZeroCopy(payload));
+		assertEquals(payload.length, r.receive(b));
+		if (s.setZeroCopy(true, 0)) {
+			assertEquals(0, s.sendZeroCopy(payload));
+			assertEquals(payload.length, r.receive(b));
+		}
+
+		assertTrue(s.close());
+		assertTrue(r.close());
+	}
+
+	function testDemux():Void {
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12006));
+		assertTrue(r.setNonBlocking(false));
+		assertFalse(r.setDemux(0, 1, 0x1F0));
+		assertFalse(r.setDemuxChannel(0, 8, 80));
+		assertTrue(r.setDemux(0, 1, 0));
+		assertTrue(r.setDemuxRoute(1, 0));
+		assertTrue(r.setDemuxRoute(2, 1));
+		assertFalse(r.setDemuxRoute(3, 256));
+		assertTrue(r.setDemuxChannel(0, 8, 80));
+		assertTrue(r.setDemuxChannel(1, 8, 80));
+		assertFalse(r.setDemuxChannel(1 << 30, 8, 80));
+
+		var s = new UdpSocket();
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12006));
+		for (opcode in [1, 2, 3, 1]) {
+			var m = Bytes.alloc(4);
+			m.set(0, opcode);
+			s.send(m);
+		}
+
+		var b = Bytes.alloc(80);
+		assertEquals(4, r.receiveChannel(1, b));
+		assertEquals(2, b.get(0));
+		assertEquals(1, r.getDemuxPending(0));
+		assertEquals(4, r.receiveChannel(0, b));
+		assertEquals(4, r.receiveChannel(0, b));
+		assertEquals(1, b.get(0));
+		assertEquals(1, r.getDemuxStats().unrouted);
+
+		assertTrue(s.close());
+		assertTrue(r.close());
+	}
+
+	function testCpu():Void {
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12007));
+		assertTrue(r.setNonBlocking(false));
+
+		var s = new UdpSocket();
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12007));
+		s.send(Bytes.ofString(msg1));
+
+		var linux = Sys.systemName() == "Linux";
+		assertEquals(linux, r.setIncomingCpu(0));
+
+		//the kernel does not measure the incoming CPU of unconnected sockets; the value set above is not reported
+		var b = Bytes.alloc(80);
+		assertEquals(msg1.length, r.receive(b));
+		assertEquals(-1, r.getIncomingCpu());
+		assertEquals(-1, r.pinToIncomingCpu());
+
+		var cpu = UdpSocket.getCurrentCpu();
+		if (linux) {
+			assertTrue(cpu >= 0 && cpu < UdpSocket.getCpuCount());
+		}
+		if (cpu >= 0 && UdpSocket.pinThreadToCpu(cpu)) {
+			assertEquals(cpu, UdpSocket.getCurrentCpu());
+			assertTrue(UdpSocket.pinThreadToCpu(-1));
+		}
+
+		assertTrue(s.close());
+		assertTrue(r.close());
+	}
+
+	function testRecordReplay():Void {
+		var path = "UdpTest.pcap";
+
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12008));
+		assertTrue(r.setNonBlocking(false));
+		assertTrue(r.startRecording(path, 1024));
+
+		var s = new UdpSocket();
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12008));
+		var b = Bytes.alloc(80);
+		for (msg in [msg1, msg2]) {
+			s.send(Bytes.ofString(msg));
+			assertEquals(msg.length, r.receive(b));
+		}
+		assertEquals(2, r.stopRecording());
+
+		assertEquals(2, s.replay(path, 0));
+		var recLen = r.receive(b);
+		assertEquals(msg1, b.getString(0, recLen));
+		recLen = r.receive(b);
+		assertEquals(msg2, b.getString(0, recLen));
+
+		// a record claiming more than the snapshot length ends the replay
+		var pcap = new haxe.io.BytesOutput();
+		for (i in [0xa1b2c3d4, 0x00040002, 0, 0, 65535, 101, 0, 0, 0x7fffffff, 0x7fffffff])
+			pcap.writeInt32(i);
+		sys.io.File.saveBytes(path, pcap.getBytes());
+		assertEquals(0, s.replay(path, 0));
+
+		assertTrue(s.close());
+		assertTrue(r.close());
+		sys.FileSystem.deleteFile(path);
+	}
+
+	function testImpairment():Void {
+		var r = new UdpSocket();
+		assertTrue(r.create());
+		assertTrue(r.bind(12009));
+		assertTrue(r.setNonBlocking(true));
+
+		var s = new UdpSocket();
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12009));
+
+		var config = { seed: 7, dropRate: 0.5, duplicateRate: 0.1, delayMicros: 1000 };
+		var b = Bytes.ofString(msg1);
+		var runs = [];
+		for (i in 0...2) {
+			assertTrue(s.setImpairment(UdpSocket.IMPAIR_SEND, config));
+			for (j in 0...40)
+				s.send(b);
+			s.flushImpairment();
+			var stats = s.getImpairmentStats(UdpSocket.IMPAIR_SEND);
+			assertEquals(0, stats.queued);
+			assertEquals(40 - stats.dropped + stats.duplicated, stats.passed);
+			runs.push(stats);
+		}
+		assertTrue(runs[0].dropped > 0);
+		assertEquals(runs[0].dropped, runs[1].dropped);
+		assertEquals(runs[0].duplicated, runs[1].duplicated);
+
+		Sys.sleep(0.05);
+		var got = 0;
+		var rb = Bytes.alloc(80);
+		while (r.receive(rb) > 0)
+			got++;
+		assertEquals(runs[0].passed + runs[1].passed, got);
+
+		assertTrue(s.setImpairment(UdpSocket.IMPAIR_SEND, { dropRate: 1.0 }));
+		s.sendAll(b);
+		assertEquals(1, s.getImpairmentStats(UdpSocket.IMPAIR_SEND).dropped);
+
+		//close() drops what is held instead of sending it from the next socket
+		assertTrue(s.setImpairment(UdpSocket.IMPAIR_SEND, { delayMicros: 1000000 }));
+		s.send(b);
+		assertEquals(1, s.getImpairmentStats(UdpSocket.IMPAIR_SEND).queued);
+		assertTrue(s.close());
+		assertEquals(1, s.getImpairmentStats(UdpSocket.IMPAIR_SEND).dropped);
+		assertTrue(s.create());
+		assertTrue(s.connect("127.0.0.1", 12009));
+		assertEquals(0, s.flushImpairment());
+
+		assertTrue(s.setImpairment(UdpSocket.IMPAIR_SEND, null));
+		assertTrue(r.setImpairment(UdpSocket.IMPAIR_RECEIVE, { dropRate: 1.0 }));
+		s.send(b);
+		Sys.sleep(0.05);
+		assertTrue(r.receive(rb) < 0);
+		assertEquals(1, r.getImpairmentStats(UdpSocket.IMPAIR_RECEIVE).dropped);
+
+		assertTrue(s.close());
+		assertTrue(r.close());
+	}
+
 	static public function main():Void {
 		var runner = new TestRunner();
 		runner.add(new UdpTest());